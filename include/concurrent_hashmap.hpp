@@ -0,0 +1,588 @@
+/**
+The MIT License (MIT)
+
+Copyright (c) 2016 Flavio Moreira
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef CONCURRENT_HASHMAP_HPP
+#define CONCURRENT_HASHMAP_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+#include "hashmap.hpp"
+
+namespace Montreal
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// ConcurrentHashMap : dynamic hash map shared by any number of threads
+///////////////////////////////////////////////////////////////////////////////
+
+// spin lock guarding a stripe of buckets
+// NOTE: padded to a cache line, so threads working on different stripes
+// do not fight over the line. count_ is the number of elements inserted
+// minus removed in the stripe buckets (changed only with the lock held).
+struct HashMapLock
+{
+  std::atomic< u32 > locked_;
+  i64 count_;
+  u8 pad_[64 - sizeof(std::atomic< u32 >) - sizeof(i64)];
+};
+
+// the same bucketized three lane cuckoo table as HashMap, with the buckets
+// guarded by striped spin locks:
+// - an operation locks the (up to 3) stripes of the key candidate buckets
+//   in increasing order, so two threads never wait on each other in a cycle.
+// - when the candidate buckets are full the displacement path is searched
+//   without holding any lock, then its moves are made one at a time, each
+//   with the stripes of its two buckets locked and checked to still be valid
+//   (the search may have seen a table that changed since).
+// NOTE: the table never grows and the stash of HashMap is not used. its
+// capacity is fixed at construction (see capacity()); emplace returns false
+// and leaves the container unchanged when no displacement path to a free
+// slot is found within maxRetries_ tries, which starts to happen once the
+// table is about 95% full. size Capacity for the peak element count: the
+// path search reads the table without any lock, so it can not be swapped
+// for a bigger one while other threads use the container.
+template < typename KeyType, typename EntryType, typename Allocator >
+struct ConcurrentHashMap
+{
+  using ElementType = typename HashMapInterface< KeyType, EntryType >::ElementType;
+  using AllocatorType = Allocator;
+
+  // max number of lock stripes (must be a power of 2)
+  GLOBAL const usize maxLocks_{4096};
+  // max number of displacement paths tried by one insertion
+  GLOBAL const usize maxRetries_{8};
+
+  HashMap< KeyType, EntryType, Allocator > map_;
+  Blk lockBlock_;
+  usize lockCount_;
+  HashMapLock* locks_;
+
+  ConcurrentHashMap() = delete;
+  ConcurrentHashMap(Allocator& alloc, const ElementType& init, const usize Capacity);
+  ConcurrentHashMap(const ConcurrentHashMap& other) = delete;
+  ConcurrentHashMap& operator=(const ConcurrentHashMap& other) = delete;
+  ~ConcurrentHashMap();
+};
+
+// GLOBAL
+template < typename KeyType, typename EntryType, typename Allocator >
+const usize ConcurrentHashMap< KeyType, EntryType, Allocator >::maxLocks_;
+template < typename KeyType, typename EntryType, typename Allocator >
+const usize ConcurrentHashMap< KeyType, EntryType, Allocator >::maxRetries_;
+
+// constructor
+template < typename KeyType, typename EntryType, typename Allocator >
+ConcurrentHashMap< KeyType, EntryType, Allocator >::ConcurrentHashMap(
+    Allocator& alloc,
+    const typename ConcurrentHashMap< KeyType, EntryType, Allocator >::ElementType& init,
+    const usize Capacity)
+    : map_(alloc, init, Capacity)
+    , lockBlock_{nullptr, 0}
+    , lockCount_(std::min(maxLocks_, roundToPow2(map_.buckets_)))
+    , locks_(nullptr)
+{
+  this->locks_ =
+      allocateType< HashMapLock, Allocator >(this->map_.alloc_, this->lockBlock_, this->lockCount_);
+  for(usize l = 0; l < this->lockCount_; l++)
+  {
+    new(this->locks_ + l) HashMapLock{{0}, 0, {}};
+  }
+}
+
+// destructor
+template < typename KeyType, typename EntryType, typename Allocator >
+ConcurrentHashMap< KeyType, EntryType, Allocator >::~ConcurrentHashMap()
+{
+  if(this->lockBlock_.ptr)
+  {
+    this->map_.alloc_.deallocate(this->lockBlock_);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Lock helpers
+///////////////////////////////////////////////////////////////////////////////
+
+// lock a stripe
+// @param lock lock to acquire
+inline void acquireLock(HashMapLock& lock)
+{
+  while(lock.locked_.exchange(1, std::memory_order_acquire))
+  {
+    while(lock.locked_.load(std::memory_order_relaxed))
+    {
+      cpuRelax();
+    }
+  }
+}
+
+// unlock a stripe
+// @param lock lock to release
+inline void releaseLock(HashMapLock& lock)
+{
+  lock.locked_.store(0, std::memory_order_release);
+}
+
+// set of (up to 3) stripes locked together, sorted and without repetitions
+struct HashMapLockSet
+{
+  usize stripes_[3];
+  u8 count_;
+};
+
+// lock the stripes of a group of buckets in increasing order
+// @param container container to access
+// @param buckets   buckets to lock
+// @param n         number of buckets (up to 3)
+// @return the set of locked stripes
+template < typename KeyType, typename EntryType, typename Allocator >
+HashMapLockSet lockBuckets(ConcurrentHashMap< KeyType, EntryType, Allocator >& container,
+                           const usize* buckets,
+                           const u8 n)
+{
+  HashMapLockSet set = {{0, 0, 0}, 0};
+  for(u8 i = 0; i < n; i++)
+  {
+    const usize stripe = buckets[i] & (container.lockCount_ - 1);
+    if(std::find(set.stripes_, (set.stripes_ + set.count_), stripe) == (set.stripes_ + set.count_))
+    {
+      set.stripes_[set.count_++] = stripe;
+    }
+  }
+  // insertion sort of (up to) 3 stripes
+  for(u8 i = 1; i < set.count_; i++)
+  {
+    for(u8 j = i; j > 0 && set.stripes_[j - 1] > set.stripes_[j]; j--)
+    {
+      std::swap(set.stripes_[j - 1], set.stripes_[j]);
+    }
+  }
+  for(u8 i = 0; i < set.count_; i++)
+  {
+    acquireLock(container.locks_[set.stripes_[i]]);
+  }
+  return set;
+}
+
+// unlock a set of stripes
+// @param container container to access
+// @param set       stripes to unlock
+template < typename KeyType, typename EntryType, typename Allocator >
+void unlockBuckets(ConcurrentHashMap< KeyType, EntryType, Allocator >& container,
+                   const HashMapLockSet& set)
+{
+  for(u8 i = set.count_; i > 0; i--)
+  {
+    releaseLock(container.locks_[set.stripes_[i - 1]]);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Concurrent cuckoo helpers
+///////////////////////////////////////////////////////////////////////////////
+
+// read a byte that may be written by another thread at the same time
+// NOTE: searchCuckooPath reads tags and keys without holding any lock, so
+// the accessors write them (with the locks held) as relaxed atomic stores
+// @param byte byte to read
+// @return byte value
+inline u8 loadRelaxed(const u8* byte)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __atomic_load_n(byte, __ATOMIC_RELAXED);
+#else
+  return reinterpret_cast< const std::atomic< u8 >* >(byte)->load(std::memory_order_relaxed);
+#endif
+}
+
+// write a byte that may be read by another thread at the same time
+// @param byte  byte to write
+// @param value new byte value
+inline void storeRelaxed(u8* byte, const u8 value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  __atomic_store_n(byte, value, __ATOMIC_RELAXED);
+#else
+  reinterpret_cast< std::atomic< u8 >* >(byte)->store(value, std::memory_order_relaxed);
+#endif
+}
+
+// copy a key out of a slot that may be written by another thread
+// NOTE: the copy may be torn, it is only a guess checked under the locks
+// @param dst receives the key
+// @param src key in the table
+template < typename KeyType >
+inline void loadKey(KeyType& dst, const KeyType& src)
+{
+  u8* to = reinterpret_cast< u8* >(&dst);
+  const u8* from = reinterpret_cast< const u8* >(&src);
+  for(usize i = 0; i < sizeof(KeyType); i++)
+  {
+    to[i] = loadRelaxed(from + i);
+  }
+}
+
+// write an element and its tag into a slot (the slot stripe must be locked)
+// @param map   table to access
+// @param pos   slot index
+// @param key   element key
+// @param value element content
+// @param tag   slot tag (0 -> free slot)
+template < typename KeyType, typename EntryType, typename Allocator >
+inline void writeSlot(HashMap< KeyType, EntryType, Allocator >& map,
+                      const usize pos,
+                      const KeyType& key,
+                      const EntryType& value,
+                      const u8 tag)
+{
+  u8* to = reinterpret_cast< u8* >(&(map.table_[pos].key));
+  const u8* from = reinterpret_cast< const u8* >(&key);
+  for(usize i = 0; i < sizeof(KeyType); i++)
+  {
+    storeRelaxed(to + i, from[i]);
+  }
+  map.table_[pos].value = value;
+  storeRelaxed(map.tags_ + pos, tag);
+}
+
+// candidate buckets of a key
+// @param container container to access
+// @param hashes    hashes of the key
+// @param buckets   receives the 3 bucket indices
+template < typename KeyType, typename EntryType, typename Allocator >
+inline void candidateBuckets(const ConcurrentHashMap< KeyType, EntryType, Allocator >& container,
+                             const Hashes& hashes,
+                             usize* buckets)
+{
+  for(u8 i = 0; i < 3; i++)
+  {
+    buckets[i] = bucketIndex(hashes.h[i], container.map_.buckets_);
+  }
+}
+
+// search a displacement path to a free slot, without holding any lock
+// NOTE: the table may change while it is read, the path found is only
+// a guess that has to be checked when its moves are made. keys are copied
+// out of the slots byte by byte, so they must be trivially copyable (and
+// default constructible to have somewhere to copy them to)
+// @param container container to access
+// @param hashes    hashes of the key to place
+// @param path      search nodes
+// @return node at the end of the path | -1 -> no path found
+template < typename KeyType, typename EntryType, typename Allocator >
+i32 searchCuckooPath(ConcurrentHashMap< KeyType, EntryType, Allocator >& container,
+                     const Hashes& hashes,
+                     CuckooPathNode* path)
+{
+  const usize slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+  const usize maxSearch = HashMapInterface< KeyType, EntryType >::maxSearch_;
+  const usize maxPathLen = HashMapInterface< KeyType, EntryType >::maxPathLen_;
+  HashMap< KeyType, EntryType, Allocator >& map = container.map_;
+  static_assert(std::is_trivially_copyable< KeyType >::value &&
+                    std::is_default_constructible< KeyType >::value,
+                "concurrent hash map keys must be trivially copyable and default constructible");
+
+  usize tail = 0;
+  for(u8 i = 0; i < 3; i++)
+  {
+    path[tail++] = {bucketIndex(hashes.h[i], map.buckets_), -1, 0, 0};
+  }
+
+  for(usize node = 0; node < tail; node++)
+  {
+    const usize first = path[node].bucket * slots;
+    u8 tags[slots];
+    for(usize s = 0; s < slots; s++)
+    {
+      tags[s] = loadRelaxed(map.tags_ + first + s);
+    }
+    if(matchTags< slots >(tags, 0))
+    {
+      return static_cast< i32 >(node);
+    }
+    if(path[node].depth >= maxPathLen)
+    {
+      continue;
+    }
+    for(usize s = 0; s < slots && tail < maxSearch; s++)
+    {
+      KeyType key;
+      loadKey(key, map.table_[first + s].key);
+      const Hashes alt = hash(key);
+      for(u8 i = 0; i < 3 && tail < maxSearch; i++)
+      {
+        const usize b = bucketIndex(alt.h[i], map.buckets_);
+        if(!onCuckooPath(path, static_cast< i32 >(node), b))
+        {
+          path[tail++] = {b,
+                          static_cast< i32 >(node),
+                          static_cast< u8 >(s),
+                          static_cast< u8 >(path[node].depth + 1)};
+        }
+      }
+    }
+  }
+  return -1;
+}
+
+// make the moves of a displacement path, last one first
+// NOTE: every move locks its two buckets and checks that the source slot
+// still holds an element that may go to the destination bucket and that
+// the destination still has a free slot, otherwise the path is abandoned
+// (the moves already made are harmless: the elements are in valid places)
+// @param container container to access
+// @param path      search nodes
+// @param node      node at the end of the path
+// @return true -> the first bucket of the path has a free slot | false -> path is stale
+template < typename KeyType, typename EntryType, typename Allocator >
+bool moveCuckooPath(ConcurrentHashMap< KeyType, EntryType, Allocator >& container,
+                    const CuckooPathNode* path,
+                    i32 node)
+{
+  const usize slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+  HashMap< KeyType, EntryType, Allocator >& map = container.map_;
+
+  while(path[node].parent >= 0)
+  {
+    const CuckooPathNode& to = path[node];
+    const CuckooPathNode& from = path[to.parent];
+    const usize buckets[2] = {to.bucket, from.bucket};
+    const HashMapLockSet set = lockBuckets(container, buckets, 2);
+
+    const usize src = from.bucket * slots + to.slot;
+    const u32 free = matchTags< slots >(map.tags_ + to.bucket * slots, 0);
+    bool valid = free && map.tags_[src];
+    if(valid)
+    {
+      usize alt[3];
+      candidateBuckets(container, hash(map.table_[src].key), alt);
+      valid = (std::find(alt, (alt + 3), to.bucket) != (alt + 3));
+    }
+    if(valid)
+    {
+      const usize dst = to.bucket * slots + countTrailingZeros(free);
+      writeSlot(map, dst, map.table_[src].key, map.table_[src].value, map.tags_[src]);
+      writeSlot(map, src, map.init_.key, map.init_.value, 0);
+      --container.locks_[from.bucket & (container.lockCount_ - 1)].count_;
+      ++container.locks_[to.bucket & (container.lockCount_ - 1)].count_;
+    }
+    unlockBuckets(container, set);
+    if(!valid)
+    {
+      return false;
+    }
+    node = to.parent;
+  }
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+// ConcurrentHashMap acessor functions
+// NOTE: every function may be called by any number of threads at once
+// ----------------------------------------------------------------------------
+
+// length of the container
+// NOTE: not a snapshot when other threads are inserting or removing
+// @param   container
+// @return  size
+template < typename KeyType, typename EntryType, typename Allocator >
+usize len(ConcurrentHashMap< KeyType, EntryType, Allocator >& container)
+{
+  i64 length = 0;
+  for(usize l = 0; l < container.lockCount_; l++)
+  {
+    acquireLock(container.locks_[l]);
+    length += container.locks_[l].count_;
+    releaseLock(container.locks_[l]);
+  }
+  return static_cast< usize >(length);
+}
+
+// number of elements the container can hold
+// @param   container
+// @return  capacity
+template < typename KeyType, typename EntryType, typename Allocator >
+inline usize capacity(ConcurrentHashMap< KeyType, EntryType, Allocator >& container)
+{
+  return container.map_.buckets_ * container.map_.bucketSlots_;
+}
+
+// clear the container
+// @param container
+template < typename KeyType, typename EntryType, typename Allocator >
+void clear(ConcurrentHashMap< KeyType, EntryType, Allocator >& container)
+{
+  HashMap< KeyType, EntryType, Allocator >& map = container.map_;
+  for(usize l = 0; l < container.lockCount_; l++)
+  {
+    acquireLock(container.locks_[l]);
+  }
+  for(usize pos = 0; pos < map.buckets_ * map.bucketSlots_; pos++)
+  {
+    writeSlot(map, pos, map.init_.key, map.init_.value, 0);
+  }
+  for(usize l = container.lockCount_; l > 0; l--)
+  {
+    container.locks_[l - 1].count_ = 0;
+    releaseLock(container.locks_[l - 1]);
+  }
+}
+
+// random accessor
+// @param container container to access
+// @param key       key of element to access
+// @param out       receives a copy of the key entry
+// return true -> found | false -> key not found
+template < typename KeyType, typename EntryType, typename Allocator >
+bool find(ConcurrentHashMap< KeyType, EntryType, Allocator >& container,
+          const KeyType& key,
+          EntryType& out)
+{
+  const Hashes hashes = hash(key);
+  usize buckets[3];
+  candidateBuckets(container, hashes, buckets);
+
+  const HashMapLockSet set = lockBuckets(container, buckets, 3);
+  typename HashMapInterface< KeyType, EntryType >::ElementType* el =
+      findElement(container.map_, key, hashes);
+  if(el)
+  {
+    out = el->value;
+  }
+  unlockBuckets(container, set);
+  return el != nullptr;
+}
+
+// count number of elements that have key
+// @param container container to access
+// @param key       key of element to access
+// return number of elements with key (keys are unique: 0 or 1)
+template < typename KeyType, typename EntryType, typename Allocator >
+usize count(ConcurrentHashMap< KeyType, EntryType, Allocator >& container, const KeyType& key)
+{
+  EntryType entry = container.map_.init_.value;
+  return find(container, key, entry) ? 1 : 0;
+}
+
+// add a new element to the key (overwrites the entry if key is present)
+// @param container container to access
+// @param key       key of element to access
+// @param entry     element content
+// return true -> inserted | false -> container is full (nothing changed)
+template < typename KeyType, typename EntryType, typename Allocator >
+bool emplace(ConcurrentHashMap< KeyType, EntryType, Allocator >& container,
+             const KeyType& key,
+             const EntryType& entry)
+{
+  const usize slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+  const usize maxSearch = HashMapInterface< KeyType, EntryType >::maxSearch_;
+  HashMap< KeyType, EntryType, Allocator >& map = container.map_;
+
+  const Hashes hashes = hash(key);
+  const u8 tag = hashTag(hashes);
+  usize buckets[3];
+  candidateBuckets(container, hashes, buckets);
+
+  CuckooPathNode path[maxSearch];
+  usize retries = 0;
+  while(true)
+  {
+    const HashMapLockSet set = lockBuckets(container, buckets, 3);
+    typename HashMapInterface< KeyType, EntryType >::ElementType* old =
+        findElement(map, key, hashes);
+    if(old)
+    {
+      old->value = entry;
+      unlockBuckets(container, set);
+      return true;
+    }
+    for(u8 i = 0; i < 3; i++)
+    {
+      const u32 free = matchTags< slots >(map.tags_ + buckets[i] * slots, 0);
+      if(free)
+      {
+        const usize dst = buckets[i] * slots + countTrailingZeros(free);
+        writeSlot(map, dst, key, entry, tag);
+        ++container.locks_[buckets[i] & (container.lockCount_ - 1)].count_;
+        unlockBuckets(container, set);
+        return true;
+      }
+    }
+    unlockBuckets(container, set);
+
+    // make room out of the locks, then try again: a stale path (the table
+    // changed since it was searched) is searched again
+    bool moved = false;
+    while(!moved)
+    {
+      if(retries++ == container.maxRetries_)
+      {
+        return false;
+      }
+      const i32 node = searchCuckooPath(container, hashes, path);
+      if(node < 0)
+      {
+        return false;
+      }
+      moved = moveCuckooPath(container, path, node);
+    }
+  }
+}
+
+// remove an element from container
+// @param container container to access
+// @param key       key of element to remove
+// return true -> removed | false -> key not found
+template < typename KeyType, typename EntryType, typename Allocator >
+bool remove(ConcurrentHashMap< KeyType, EntryType, Allocator >& container, const KeyType& key)
+{
+  const usize slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+  HashMap< KeyType, EntryType, Allocator >& map = container.map_;
+
+  const Hashes hashes = hash(key);
+  usize buckets[3];
+  candidateBuckets(container, hashes, buckets);
+
+  const HashMapLockSet set = lockBuckets(container, buckets, 3);
+  typename HashMapInterface< KeyType, EntryType >::ElementType* el =
+      findElement(map, key, hashes);
+  if(el)
+  {
+    const usize pos = el - map.table_;
+    writeSlot(map, pos, map.init_.key, map.init_.value, 0);
+    --container.locks_[(pos / slots) & (container.lockCount_ - 1)].count_;
+  }
+  unlockBuckets(container, set);
+  return el != nullptr;
+}
+
+} // end namespace Montreal
+
+#endif // CONCURRENT_HASHMAP_HPP
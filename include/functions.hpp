@@ -25,6 +25,10 @@ SOFTWARE.
 #ifndef FUNCTIONS_HPP
 #define FUNCTIONS_HPP
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "basic_types.hpp"
 
 namespace Montreal
@@ -53,6 +57,63 @@ usize roundToAlign(const usize& bytes, const usize alignment = 8)
   return rounded;
 }
 
+// index of the lowest set bit
+// NOTE: undefined for 0
+// @param bits value to scan
+// @return number of trailing zero bits
+inline u32 countTrailingZeros(const u64 bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast< u32 >(__builtin_ctzll(bits));
+#else
+  u32 n = 0;
+  for(u64 b = bits; !(b & 0x01); b >>= 1)
+  {
+    ++n;
+  }
+  return n;
+#endif
+}
+
+// number of zero bits above the highest set bit
+// NOTE: undefined for 0
+// @param bits value to scan
+// @return number of leading zero bits
+inline u32 countLeadingZeros(const u64 bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast< u32 >(__builtin_clzll(bits));
+#else
+  u32 n = 0;
+  for(u64 b = bits; !(b & 0x8000000000000000ULL); b <<= 1)
+  {
+    ++n;
+  }
+  return n;
+#endif
+}
+
+// hint the cpu to bring the cache line holding ptr closer
+// @param ptr address to prefetch
+inline void prefetch(const void* ptr)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(ptr);
+#else
+  (void)ptr;
+#endif
+}
+
+// tell the cpu the thread is spinning on a busy wait
+inline void cpuRelax()
+{
+#if defined(__SSE2__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
 } // end namespace Montreal
 
 #endif // FUNCTIONS_HPP
@@ -25,6 +25,11 @@ SOFTWARE.
 #ifndef HASH_HPP
 #define HASH_HPP
 
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
 #include "basic_types.hpp"
 #include "hashes/City.h"
 #include "hashes/MurmurHash2.h"
@@ -33,36 +38,429 @@ SOFTWARE.
 namespace Montreal
 {
 
+// hash lanes of a key
+// by default all lanes come from one pass of a 128 bit hash, defining
+// MONTREAL_TRIPLE_HASH selects the previous mode of one 64 bit hash
+// algorithm per lane (3 passes over the key).
+// NOTE: h is the first union member so hashes can be built in constexpr code
 struct Hashes
 {
   union {
+    u64 h[3];
     struct
     {
       u64 murmur;
       u64 city;
       u64 spooky;
     };
-    u64 h[3];
   };
 };
 
-template < typename KeyType >
-Hashes hash(const KeyType& key, u64 seed = 0x9747b28c)
+// default seed of the hash functions
+GLOBAL const u64 defaultHashSeed = 0x9747b28c;
+
+// build the hash lanes out of a 128 bit hash
+// NOTE: the lanes are split so that the bits each one contributes to
+// bucketIndex (lower 32 bits) and to the HashMap tag (top 8 bits of lane 0)
+// never overlap.
+// @param lo lower 64 bits of the hash
+// @param hi upper 64 bits of the hash
+// @return hash lanes
+constexpr Hashes hashLanes(const u64 lo, const u64 hi)
+{
+  return Hashes{{{lo, hi, (hi >> 32) | (hi << 32)}}};
+}
+
+// bijective 64 bit multiply-xorshift mixer
+// @param x value to mix
+// @return mixed value
+constexpr u64 mix64(u64 x)
+{
+  x ^= x >> 32;
+  x *= 0xd6e8feb86659fd93ULL;
+  x ^= x >> 32;
+  x *= 0xd6e8feb86659fd93ULL;
+  x ^= x >> 32;
+  return x;
+}
+
+// 64x64 -> 128 bit multiply folded back into 64 bits
+// @param a first factor
+// @param b second factor
+// @return lower ^ upper half of the product
+constexpr u64 mulFold(const u64 a, const u64 b)
+{
+#if defined(__SIZEOF_INT128__)
+  const unsigned __int128 p = static_cast< unsigned __int128 >(a) * b;
+  return static_cast< u64 >(p) ^ static_cast< u64 >(p >> 64);
+#else
+  return mix64(a ^ b);
+#endif
+}
+
+// hash lanes of a byte buffer
+// @param buf  data to hash
+// @param len  length in bytes
+// @param seed hash seed
+// @return hash lanes
+inline Hashes hashBytes(const void* buf, const usize len, const u64 seed = defaultHashSeed)
 {
-  const usize len(sizeof(KeyType));
+  const char* bytes = static_cast< const char* >(buf);
 
+#if defined(MONTREAL_TRIPLE_HASH)
   Hashes rVal = {{{0, 0, 0}}};
+  rVal.city = CityHash64WithSeed(bytes, len, seed);
+  rVal.murmur = MurmurHash64A(bytes, static_cast< int >(len), seed);
+  rVal.spooky = SpookyHash::Hash64(bytes, len, seed);
+  return rVal;
+#else
+  // NOTE: same result as CityHash128WithSeed up to 900 bytes, longer keys
+  // go through the CRC32C variant (hardware crc32 when the host has it)
+  const uint128 h = CityHashCrc128WithSeed(bytes, len, uint128(seed, ~seed));
+  return hashLanes(Uint128Low64(h), Uint128High64(h));
+#endif
+}
 
-  union {
-    KeyType key_;
-    u8 buf_[len];
-  } buffer;
+// hash lanes of a buffer of up to 16 bytes, mixed inline (no call into City)
+// @param buf  data to hash
+// @param len  length in bytes (<= 16)
+// @param seed hash seed
+// @return hash lanes
+inline Hashes hashShort(const void* buf, const usize len, const u64 seed = defaultHashSeed)
+{
+  u64 words[2] = {0, 0};
+  std::memcpy(words, buf, len);
+  const u64 lo = mix64(mix64(words[0] ^ seed) ^ (words[1] + len));
+  return hashLanes(lo, mulFold(lo, 0x9e3779b97f4a7c15ULL));
+}
+
+// hash lanes of a character sequence, computable at compile time
+// NOTE: the bytes are gathered into words one at a time (no memcpy) so it
+// runs in constexpr code, it does not match hashBytes over the same data
+// @param chars characters to hash
+// @param len   number of characters
+// @param seed  hash seed
+// @return hash lanes
+constexpr Hashes hashChars(const char* chars, const usize len, const u64 seed = defaultHashSeed)
+{
+  u64 acc = seed ^ (len * 0x9e3779b97f4a7c15ULL);
+  for(usize first = 0; first < len; first += 8)
+  {
+    u64 word = 0;
+    for(usize i = first; i < len && i < first + 8; i++)
+    {
+      word |= static_cast< u64 >(static_cast< u8 >(chars[i])) << (8 * (i - first));
+    }
+    acc = mix64(acc ^ word) + first;
+  }
+  const u64 lo = mix64(acc);
+  return hashLanes(lo, mulFold(lo, 0x9e3779b97f4a7c15ULL));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Hasher: customization point choosing how each key type is hashed
+///////////////////////////////////////////////////////////////////////////////
+
+// how hashBatch may hash several keys of a type in lockstep
+// (Hasher::batchMode_, specializations without it are hashed one by one)
+enum HashBatchMode
+{
+  HASH_BATCH_NONE = 0,    // call Hasher::hash per key
+  HASH_BATCH_INTEGER = 1, // the Hasher of integers
+  HASH_BATCH_SHORT = 2    // hashShort over the key bytes
+};
 
-  buffer.key_ = key;
+// default: hash the raw bytes of the key (inline for keys up to 16 bytes)
+// NOTE: keys that own memory (pointers to their content) or have padding
+// bytes must specialize Hasher (see hashComposite)
+template < typename KeyType, typename Enable = void >
+struct Hasher
+{
+  GLOBAL constexpr HashBatchMode batchMode_ =
+      (sizeof(KeyType) <= 16) ? HASH_BATCH_SHORT : HASH_BATCH_NONE;
+
+  static Hashes hash(const KeyType& key, const u64 seed)
+  {
+    static_assert(std::is_trivially_copyable< KeyType >::value,
+                  "keys that are not trivially copyable need a Hasher specialization");
+    return (sizeof(KeyType) <= 16) ? hashShort(&key, sizeof(KeyType), seed)
+                                   : hashBytes(&key, sizeof(KeyType), seed);
+  }
+};
+
+// integers and enums: one mix per lane pair instead of a full hash pass
+template < typename KeyType >
+struct Hasher< KeyType,
+               typename std::enable_if< std::is_integral< KeyType >::value ||
+                                        std::is_enum< KeyType >::value >::type >
+{
+  GLOBAL constexpr HashBatchMode batchMode_ = HASH_BATCH_INTEGER;
+
+  static constexpr Hashes hash(const KeyType& key, const u64 seed)
+  {
+    const u64 lo = mix64(static_cast< u64 >(key) ^ seed);
+    return hashLanes(lo, mulFold(lo, 0x9e3779b97f4a7c15ULL));
+  }
+};
+
+// pointers: hash the address (consistent with comparing pointers with ==)
+template < typename Type >
+struct Hasher< Type* >
+{
+  static Hashes hash(Type* const& key, const u64 seed)
+  {
+    return Hasher< usize >::hash(reinterpret_cast< usize >(key), seed);
+  }
+};
+
+// fold the hashes of the parts of a composite key into one seed
+// @param seed  hash seed
+// @param parts parts of the key
+// @return seed carrying the hash of all parts
+constexpr u64 hashCombine(const u64 seed) { return seed; }
+
+template < typename Part, typename... Parts >
+constexpr u64 hashCombine(const u64 seed, const Part& part, const Parts&... parts)
+{
+  return hashCombine(Hasher< Part >::hash(part, seed).h[0], parts...);
+}
+
+// hash lanes of a composite key (structs can implement Hasher with it)
+// @param seed  hash seed
+// @param parts parts of the key
+// @return hash lanes
+template < typename... Parts >
+constexpr Hashes hashComposite(const u64 seed, const Parts&... parts)
+{
+  return Hasher< u64 >::hash(hashCombine(seed, parts...), seed);
+}
+
+// pairs and tuples: composite of their members
+template < typename First, typename Second >
+struct Hasher< std::pair< First, Second > >
+{
+  static constexpr Hashes hash(const std::pair< First, Second >& key, const u64 seed)
+  {
+    return hashComposite(seed, key.first, key.second);
+  }
+};
+
+template < typename... Parts >
+struct Hasher< std::tuple< Parts... > >
+{
+  static constexpr Hashes hash(const std::tuple< Parts... >& key, const u64 seed)
+  {
+    return hashTuple(key, seed, std::index_sequence_for< Parts... >{});
+  }
+
+private:
+  template < usize... index >
+  static constexpr Hashes
+  hashTuple(const std::tuple< Parts... >& key, const u64 seed, std::index_sequence< index... >)
+  {
+    return hashComposite(seed, std::get< index >(key)...);
+  }
+};
 
-  rVal.city = CityHash64WithSeed(buffer.buf_, len, seed);
-  rVal.murmur = MurmurHash64A(buffer.buf_, len, seed);
-  rVal.spooky = SpookyHash::Hash64(buffer.buf_, len, seed);
+///////////////////////////////////////////////////////////////////////////////
+// StreamHasher: incremental hashing of data that arrives in chunks
+///////////////////////////////////////////////////////////////////////////////
+
+// wraps the SpookyHash Init/Update/Final state machine: chunks are mixed in
+// as they arrive (only a partial block is kept) and the state can be copied
+// to fork the stream.
+// NOTE: the lanes come from SpookyHash128 over the concatenated chunks, so
+// they do not match hashBytes over the same data
+class StreamHasher
+{
+public:
+  explicit StreamHasher(const u64 seed = defaultHashSeed);
+
+  void update(const void* chunk, const usize len);
+  Hashes digest();
+  StreamHasher fork() const;
+
+private:
+  SpookyHash state_;
+};
+
+// constructor
+// @param seed hash seed
+inline StreamHasher::StreamHasher(const u64 seed)
+    : state_{}
+{
+  this->state_.Init(seed, ~seed);
+}
+
+// mix the next chunk of the stream
+// @param chunk data to hash
+// @param len   length in bytes
+inline void StreamHasher::update(const void* chunk, const usize len)
+{
+  this->state_.Update(chunk, len);
+}
+
+// hash of the data fed so far
+// NOTE: the stream can keep being updated afterwards
+// @return hash lanes
+inline Hashes StreamHasher::digest()
+{
+  uint64 lo = 0;
+  uint64 hi = 0;
+  this->state_.Final(&lo, &hi);
+  return hashLanes(lo, hi);
+}
+
+// copy of the stream state, both streams continue independently
+// @return forked stream
+inline StreamHasher StreamHasher::fork() const { return *this; }
+
+// hash lanes of a key (as chosen by Hasher)
+// @param key  key to hash
+// @param seed hash seed
+// @return hash lanes
+template < typename KeyType >
+constexpr Hashes hash(const KeyType& key, const u64 seed = defaultHashSeed)
+{
+  return Hasher< KeyType >::hash(key, seed);
+}
+
+// hash lanes of a probe as the key type it stands for (heterogeneous lookup)
+// NOTE: Hasher< KeyType > must have a hash overload for ProbeType that gives
+// the same lanes as hashing the equal KeyType
+// @param probe value standing for a key
+// @param seed  hash seed
+// @return hash lanes
+template < typename KeyType, typename ProbeType >
+constexpr Hashes hashAs(const ProbeType& probe, const u64 seed = defaultHashSeed)
+{
+  return Hasher< KeyType >::hash(probe, seed);
+}
+
+// batch mode of a key type (HASH_BATCH_NONE when its Hasher has none)
+template < typename KeyType, typename Enable = void >
+struct HashBatchModeOf : std::integral_constant< HashBatchMode, HASH_BATCH_NONE >
+{
+};
+
+template < typename KeyType >
+struct HashBatchModeOf< KeyType,
+                        typename std::enable_if< (Hasher< KeyType >::batchMode_ ==
+                                                  Hasher< KeyType >::batchMode_) >::type >
+    : std::integral_constant< HashBatchMode, Hasher< KeyType >::batchMode_ >
+{
+};
+
+// one mix64 step on 4 independent values
+// NOTE: written out value by value, the 4 multiply chains overlap in the
+// out-of-order engine (a loop over an array gets vectorized by the compiler
+// into emulated 64 bit multiplies, which is slower)
+#define MONTREAL_MIX_STEP(x0, x1, x2, x3)                                                          \
+  x0 ^= x0 >> 32;                                                                                  \
+  x1 ^= x1 >> 32;                                                                                  \
+  x2 ^= x2 >> 32;                                                                                  \
+  x3 ^= x3 >> 32;                                                                                  \
+  x0 *= 0xd6e8feb86659fd93ULL;                                                                     \
+  x1 *= 0xd6e8feb86659fd93ULL;                                                                     \
+  x2 *= 0xd6e8feb86659fd93ULL;                                                                     \
+  x3 *= 0xd6e8feb86659fd93ULL;
+
+// mix64 of 4 values in lockstep
+// @param x0..x3 values to mix (mixed in place)
+inline void mix64x4(u64& x0, u64& x1, u64& x2, u64& x3)
+{
+  MONTREAL_MIX_STEP(x0, x1, x2, x3)
+  MONTREAL_MIX_STEP(x0, x1, x2, x3)
+  x0 ^= x0 >> 32;
+  x1 ^= x1 >> 32;
+  x2 ^= x2 >> 32;
+  x3 ^= x3 >> 32;
+}
+
+#undef MONTREAL_MIX_STEP
+
+// hash lanes out of a mixed value (as the integer Hasher and hashShort)
+inline Hashes mixedLanes(const u64 lo) { return hashLanes(lo, mulFold(lo, 0x9e3779b97f4a7c15ULL)); }
+
+// hash lanes of a group of 4 keys: one Hasher call per key
+template < typename KeyType >
+inline void hashGroup(const KeyType* keys,
+                      Hashes* out,
+                      const u64 seed,
+                      std::integral_constant< HashBatchMode, HASH_BATCH_NONE >)
+{
+  out[0] = Hasher< KeyType >::hash(keys[0], seed);
+  out[1] = Hasher< KeyType >::hash(keys[1], seed);
+  out[2] = Hasher< KeyType >::hash(keys[2], seed);
+  out[3] = Hasher< KeyType >::hash(keys[3], seed);
+}
+
+// hash lanes of a group of 4 integer keys (same lanes as their Hasher)
+template < typename KeyType >
+inline void hashGroup(const KeyType* keys,
+                      Hashes* out,
+                      const u64 seed,
+                      std::integral_constant< HashBatchMode, HASH_BATCH_INTEGER >)
+{
+  u64 x0 = static_cast< u64 >(keys[0]) ^ seed;
+  u64 x1 = static_cast< u64 >(keys[1]) ^ seed;
+  u64 x2 = static_cast< u64 >(keys[2]) ^ seed;
+  u64 x3 = static_cast< u64 >(keys[3]) ^ seed;
+  mix64x4(x0, x1, x2, x3);
+  out[0] = mixedLanes(x0);
+  out[1] = mixedLanes(x1);
+  out[2] = mixedLanes(x2);
+  out[3] = mixedLanes(x3);
+}
+
+// hash lanes of a group of 4 keys of up to 16 bytes (same lanes as hashShort)
+template < typename KeyType >
+inline void hashGroup(const KeyType* keys,
+                      Hashes* out,
+                      const u64 seed,
+                      std::integral_constant< HashBatchMode, HASH_BATCH_SHORT >)
+{
+  u64 w[4][2] = {};
+  std::memcpy(w[0], &keys[0], sizeof(KeyType));
+  std::memcpy(w[1], &keys[1], sizeof(KeyType));
+  std::memcpy(w[2], &keys[2], sizeof(KeyType));
+  std::memcpy(w[3], &keys[3], sizeof(KeyType));
+  u64 x0 = w[0][0] ^ seed;
+  u64 x1 = w[1][0] ^ seed;
+  u64 x2 = w[2][0] ^ seed;
+  u64 x3 = w[3][0] ^ seed;
+  mix64x4(x0, x1, x2, x3);
+  x0 ^= w[0][1] + sizeof(KeyType);
+  x1 ^= w[1][1] + sizeof(KeyType);
+  x2 ^= w[2][1] + sizeof(KeyType);
+  x3 ^= w[3][1] + sizeof(KeyType);
+  mix64x4(x0, x1, x2, x3);
+  out[0] = mixedLanes(x0);
+  out[1] = mixedLanes(x1);
+  out[2] = mixedLanes(x2);
+  out[3] = mixedLanes(x3);
+}
+
+// hash lanes of a batch of keys
+// NOTE: integer keys and keys of up to 16 bytes hashed by the default
+// Hasher run 4 hashes in lockstep (interleaved mix chains),
+// other keys are hashed one by one. keys are read in place (never copied).
+// @param keys keys to hash
+// @param n    number of keys
+// @param out  hash lanes of each key
+// @param seed hash seed
+template < typename KeyType >
+void hashBatch(const KeyType* keys, const usize n, Hashes* out, const u64 seed = defaultHashSeed)
+{
+  usize i = 0;
+  for(; (i + 4) <= n; i += 4)
+  {
+    hashGroup(keys + i, out + i, seed, HashBatchModeOf< KeyType >{});
+  }
+  for(; i < n; i++)
+  {
+    out[i] = Hasher< KeyType >::hash(keys[i], seed);
+  }
 }
 
 } // end namespace Montreal
@@ -351,12 +351,87 @@ uint128 CityHash128(const char *s, size_t len) {
   }
 }
 
+// CRC32C (the polynomial of the SSE4.2 crc32 instruction) steps used by
+// CityHashCrc256.  The software step computes the same values as the
+// instruction, so the Crc hashes are identical on every host; the hardware
+// step is picked at runtime (or at compile time when the target has it).
 #if defined(__SSE4_2__) && defined(__x86_64__)
 #include <nmmintrin.h>
+#define CITY_CRC_HARDWARE
+#define CITY_CRC_STATIC_HARDWARE
+#elif defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CITY_CRC_HARDWARE __attribute__((target("sse4.2")))
+#define CITY_CRC_FLATTEN __attribute__((flatten))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <nmmintrin.h>
+#define CITY_CRC_HARDWARE
+#define CITY_CRC_FLATTEN
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CITY_CRC_STATIC_HARDWARE
+#endif
+
+namespace {
+
+// Slice-by-8 tables of the reflected CRC32C polynomial.  Built at compile
+// time, so using them needs no initialization guard.
+struct CrcTables {
+  uint32 t[8][256];
+
+  constexpr CrcTables() : t{} {
+    for (uint32 n = 0; n < 256; ++n) {
+      uint32 crc = n;
+      for (int k = 0; k < 8; ++k) {
+        crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+      }
+      t[0][n] = crc;
+    }
+    for (uint32 n = 0; n < 256; ++n) {
+      for (int k = 1; k < 8; ++k) {
+        t[k][n] = (t[k - 1][n] >> 8) ^ t[0][t[k - 1][n] & 0xff];
+      }
+    }
+  }
+};
+
+constexpr CrcTables kCrcTables;
+
+struct CrcSoftware {
+  const CrcTables& tables;
+
+  inline uint64 Step(uint64 crc, uint64 v) const {
+    const uint32 lo = static_cast<uint32>(crc) ^ static_cast<uint32>(v);
+    const uint32 hi = static_cast<uint32>(v >> 32);
+    return tables.t[7][lo & 0xff] ^ tables.t[6][(lo >> 8) & 0xff] ^
+           tables.t[5][(lo >> 16) & 0xff] ^ tables.t[4][lo >> 24] ^
+           tables.t[3][hi & 0xff] ^ tables.t[2][(hi >> 8) & 0xff] ^
+           tables.t[1][(hi >> 16) & 0xff] ^ tables.t[0][hi >> 24];
+  }
+};
+
+#if defined(CITY_CRC_STATIC_HARDWARE) && defined(__ARM_FEATURE_CRC32)
+struct CrcHardware {
+  inline uint64 Step(uint64 crc, uint64 v) const {
+    return __crc32cd(static_cast<uint32>(crc), v);
+  }
+};
+#elif defined(CITY_CRC_HARDWARE) || defined(CITY_CRC_STATIC_HARDWARE)
+struct CrcHardware {
+  CITY_CRC_HARDWARE inline uint64 Step(uint64 crc, uint64 v) const {
+    return _mm_crc32_u64(crc, v);
+  }
+};
+#endif
+
+}  // namespace
 
 // Requires len >= 240.
-static void CityHashCrc256Long(const char *s, size_t len,
-                               uint32 seed, uint64 *result) {
+template <typename Crc>
+static inline void CityHashCrc256LongImpl(const char *s, size_t len,
+                                          uint32 seed, uint64 *result,
+                                          const Crc crc) {
   uint64 a = Fetch64(s + 56) + k0;
   uint64 b = Fetch64(s + 96) + k0;
   uint64 c = result[0] = HashLen16(b, len);
@@ -383,11 +458,11 @@ static void CityHashCrc256Long(const char *s, size_t len,
       e = Rotate(t, 25 ^ z) * multiplier + Fetch64(s + 32);     \
       t = old_a;                                                \
     }                                                           \
-    f = _mm_crc32_u64(f, a);                                    \
-    g = _mm_crc32_u64(g, b);                                    \
-    h = _mm_crc32_u64(h, c);                                    \
-    i = _mm_crc32_u64(i, d);                                    \
-    j = _mm_crc32_u64(j, e);                                    \
+    f = crc.Step(f, a);                                     \
+    g = crc.Step(g, b);                                     \
+    h = crc.Step(h, c);                                     \
+    i = crc.Step(i, d);                                     \
+    j = crc.Step(j, e);                                     \
     s += 40
 
     CHUNK(1, 1); CHUNK(k0, 0);
@@ -423,6 +498,60 @@ static void CityHashCrc256Long(const char *s, size_t len,
   result[3] = a + result[2];
 }
 
+#if defined(CITY_CRC_STATIC_HARDWARE)
+
+bool CityHashCrcHardware() {
+  return true;
+}
+
+static void CityHashCrc256Long(const char *s, size_t len,
+                               uint32 seed, uint64 *result) {
+  CityHashCrc256LongImpl(s, len, seed, result, CrcHardware());
+}
+
+#elif defined(CITY_CRC_HARDWARE)
+
+bool CityHashCrcHardware() {
+#if defined(_MSC_VER)
+  static const bool supported = [] {
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+  }();
+#else
+  static const bool supported = __builtin_cpu_supports("sse4.2");
+#endif
+  return supported;
+}
+
+// flatten: inline the generic body and its crc32 steps in this sse4.2 context
+CITY_CRC_FLATTEN CITY_CRC_HARDWARE static void CityHashCrc256LongHardware(
+    const char *s, size_t len, uint32 seed, uint64 *result) {
+  CityHashCrc256LongImpl(s, len, seed, result, CrcHardware());
+}
+
+static void CityHashCrc256Long(const char *s, size_t len,
+                               uint32 seed, uint64 *result) {
+  if (LIKELY(CityHashCrcHardware())) {
+    CityHashCrc256LongHardware(s, len, seed, result);
+  } else {
+    CityHashCrc256LongImpl(s, len, seed, result, CrcSoftware{kCrcTables});
+  }
+}
+
+#else
+
+bool CityHashCrcHardware() {
+  return false;
+}
+
+static void CityHashCrc256Long(const char *s, size_t len,
+                               uint32 seed, uint64 *result) {
+  CityHashCrc256LongImpl(s, len, seed, result, CrcSoftware{kCrcTables});
+}
+
+#endif
+
 // Requires len < 240.
 static void CityHashCrc256Short(const char *s, size_t len, uint64 *result) {
   char buf[240];
@@ -461,5 +590,3 @@ uint128 CityHashCrc128(const char *s, size_t len) {
     return uint128(result[2], result[3]);
   }
 }
-
-#endif
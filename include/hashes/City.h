@@ -106,9 +106,12 @@ inline uint64 Hash128to64(const uint128& x)
   return b;
 }
 
-// Conditionally include declarations for versions of City that require SSE4.2
-// instructions to be available.
-#if defined(__SSE4_2__) && defined(__x86_64__)
+// Versions of City built on CRC32C.  They use the SSE4.2 (or ARMv8 CRC)
+// crc32 instruction when the host has it (checked at runtime on x86-64) and
+// an equivalent software CRC elsewhere, so results are the same everywhere.
+
+// True when the Crc functions run on the hardware crc32 instruction.
+bool CityHashCrcHardware();
 
 // Hash function for a byte array.
 uint128 CityHashCrc128(const char* s, size_t len);
@@ -120,6 +123,4 @@ uint128 CityHashCrc128WithSeed(const char* s, size_t len, uint128 seed);
 // Hash function for a byte array.  Sets result[0] ... result[3].
 void CityHashCrc256(const char* s, size_t len, uint64* result);
 
-#endif // __SSE4_2__
-
 #endif // CITY_HASH_H_
@@ -48,6 +48,8 @@ typedef uint8_t uint8;
 class SpookyHash
 {
 public:
+  SpookyHash(){};
+
   //
   // SpookyHash: hash a single message in one call, produce 128-bit output
   //
@@ -387,8 +389,6 @@ public:
   }
 
 private:
-  SpookyHash(){};
-
   // Short is used for messages under 192 bytes in length
   // Short has a low startup cost, the normal mode is good for long
   // keys, the cost crossover is at about 192 bytes.  The two modes were
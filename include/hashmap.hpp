@@ -25,6 +25,18 @@ SOFTWARE.
 #ifndef HASHMAP_HPP
 #define HASHMAP_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "array.hpp"
 #include "hash.hpp"
 #include "pointers.hpp"
@@ -34,13 +46,45 @@ namespace Montreal
 // forward declarations
 struct Allocator;
 
+// hash map engines (layout and probing of the table)
+struct CuckooEngine; // bucketized cuckoo hashing, suits read mostly maps
+struct SwissEngine;  // group probed open addressing, suits insert / remove churn
+
+template < typename KeyType, typename EntryType, typename Engine = CuckooEngine >
+struct HashMapInterface;
+template < typename KeyType, typename EntryType, usize Capacity, typename Engine = CuckooEngine >
+struct FixedHashMap;
+template < typename KeyType, typename EntryType, typename Allocator, typename Engine = CuckooEngine >
+struct HashMap;
+
 ///////////////////////////////////////////////////////////////////////////////
 // HashMap
 ///////////////////////////////////////////////////////////////////////////////
 
-// TODO: Implement
+// version counters of a map shared by concurrent readers and one writer:
+// the writer makes the counter of a bucket odd while it changes the bucket
+// and even again when it is done, readers never lock, they retry a lookup
+// when the counter of a bucket they read changed in the meantime.
+// buckets share counters in stripes, the last counter guards the stash.
+struct HashMapVersions
+{
+  GLOBAL const usize stripes_{1024}; // must be a power of 2
+
+  std::atomic< u32 > counters_[stripes_ + 1];
+};
+
+// bucketized cuckoo hash map:
+// each key has 3 candidate buckets (one per Hashes lane) and each bucket
+// holds a cache line worth of slots, so a lookup touches at most 3 buckets
+// plus a small stash that keeps the (rare) keys that failed displacement.
+// every slot has an 8 bit tag (key fingerprint) kept in a parallel array,
+// a bucket of tags is compared at once and only matching slots have their
+// keys compared. tag 0 marks a free slot.
+// containers that can grow (HashMap) rehash incrementally: the previous
+// table is kept while its buckets are moved, a few per write operation,
+// into the new table and lookups probe both tables in the meantime.
 template < typename KeyType, typename EntryType >
-struct HashMapInterface
+struct HashMapInterface< KeyType, EntryType, CuckooEngine >
 {
   struct ElementType
   {
@@ -48,23 +92,83 @@ struct HashMapInterface
     EntryType value;
   };
 
+  // slots per bucket
+  GLOBAL const usize bucketSlots_{(sizeof(ElementType) <= 8) ? 8 : 4};
+  // overflow slots for the keys that could not be placed in the table
+  GLOBAL const usize stashSize_{4};
+  // max number of buckets visited searching for a displacement path
+  GLOBAL const usize maxSearch_{128};
+  // max number of elements moved by one insertion
+  GLOBAL const usize maxPathLen_{4};
+  // table load (in percent) that makes a growable container grow
+  GLOBAL const usize maxLoad_{90};
+  // old table buckets migrated by each write operation while rehashing
+  GLOBAL const usize migrateStep_{4};
+
+  // replace the table by a larger (empty) one, the current table becomes
+  // the old table to be migrated
+  // return true -> grown | false -> container can not grow
+  virtual bool growTable() = 0;
+  // release the old table once it is completely migrated
+  virtual void releaseOldTable() = 0;
+
   ElementType init_;
   usize length_;
+  usize buckets_;
+  ElementType* table_;
+  u8* tags_;
+  usize stashLen_;
+  // NOTE: the stash slots are built in place from init_, so keys need not
+  // be default constructible
+  alignas(ElementType) u8 stashBuffer_[stashSize_ * sizeof(ElementType)];
+  ElementType* stash_;
+  u8 stashTags_[stashSize_];
+  HashMapVersions* versions_; // nullptr unless shared with concurrent readers
+  ElementType* oldTable_;     // table being migrated (nullptr unless rehashing)
+  u8* oldTags_;
+  usize oldBuckets_;
+  usize migrated_; // old table buckets already migrated
 
-  virtual ~HashMapInterface() {}
+  virtual ~HashMapInterface();
   HashMapInterface() = delete;
   explicit HashMapInterface(const ElementType& init);
   explicit HashMapInterface(const HashMapInterface& other);
   // TODO: Move constructor???
 };
 
+// GLOBAL
+template < typename KeyType, typename EntryType >
+const usize HashMapInterface< KeyType, EntryType >::bucketSlots_;
+template < typename KeyType, typename EntryType >
+const usize HashMapInterface< KeyType, EntryType >::stashSize_;
+template < typename KeyType, typename EntryType >
+const usize HashMapInterface< KeyType, EntryType >::maxSearch_;
+template < typename KeyType, typename EntryType >
+const usize HashMapInterface< KeyType, EntryType >::maxPathLen_;
+template < typename KeyType, typename EntryType >
+const usize HashMapInterface< KeyType, EntryType >::maxLoad_;
+template < typename KeyType, typename EntryType >
+const usize HashMapInterface< KeyType, EntryType >::migrateStep_;
+
 // default constructor
 template < typename KeyType, typename EntryType >
 HashMapInterface< KeyType, EntryType >::HashMapInterface(
     const typename HashMapInterface< KeyType, EntryType >::ElementType& init)
     : init_(init)
     , length_(0)
+    , buckets_(0)
+    , table_(nullptr)
+    , tags_(nullptr)
+    , stashLen_(0)
+    , stash_(reinterpret_cast< ElementType* >(stashBuffer_))
+    , stashTags_{}
+    , versions_(nullptr)
+    , oldTable_(nullptr)
+    , oldTags_(nullptr)
+    , oldBuckets_(0)
+    , migrated_(0)
 {
+  std::uninitialized_fill(this->stash_, (this->stash_ + stashSize_), this->init_);
 }
 
 // copy constructor
@@ -73,7 +177,30 @@ HashMapInterface< KeyType, EntryType >::HashMapInterface(
     const HashMapInterface< KeyType, EntryType >& other)
     : init_(other.init_)
     , length_(other.length_)
+    , buckets_(0)
+    , table_(nullptr)
+    , tags_(nullptr)
+    , stashLen_(other.stashLen_)
+    , stash_(reinterpret_cast< ElementType* >(stashBuffer_))
+    , stashTags_{}
+    , versions_(nullptr)
+    , oldTable_(nullptr)
+    , oldTags_(nullptr)
+    , oldBuckets_(0)
+    , migrated_(0)
+{
+  std::uninitialized_copy(other.stash_, (other.stash_ + stashSize_), this->stash_);
+  std::copy(other.stashTags_, (other.stashTags_ + stashSize_), this->stashTags_);
+}
+
+// virtual destructor
+template < typename KeyType, typename EntryType >
+HashMapInterface< KeyType, EntryType >::~HashMapInterface()
 {
+  for(usize s = 0; s < stashSize_; s++)
+  {
+    this->stash_[s].~ElementType();
+  }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -81,24 +208,44 @@ HashMapInterface< KeyType, EntryType >::HashMapInterface(
 ///////////////////////////////////////////////////////////////////////////////
 
 template < typename KeyType, typename EntryType, usize Capacity >
-struct FixedHashMap : public HashMapInterface< KeyType, EntryType >
+struct FixedHashMap< KeyType, EntryType, Capacity, CuckooEngine >
+    : public HashMapInterface< KeyType, EntryType >
 {
-  FixedArray< typename HashMapInterface< KeyType, EntryType >::ElementType, Capacity > data_;
+  using ElementType = typename HashMapInterface< KeyType, EntryType >::ElementType;
+  GLOBAL const usize bucketCount_{(Capacity + HashMapInterface< KeyType, EntryType >::bucketSlots_ -
+                                   1) /
+                                  HashMapInterface< KeyType, EntryType >::bucketSlots_};
+
+  FixedArray< ElementType, bucketCount_ * HashMapInterface< KeyType, EntryType >::bucketSlots_ >
+      data_;
+  u8 tagBuffer_[bucketCount_ * HashMapInterface< KeyType, EntryType >::bucketSlots_];
+
+  virtual bool growTable() override { return false; };
+  virtual void releaseOldTable() override {};
 
   virtual ~FixedHashMap() {}
   FixedHashMap() = delete;
-  explicit FixedHashMap(const typename HashMapInterface< KeyType, EntryType >::ElementType& init);
+  explicit FixedHashMap(const ElementType& init);
   explicit FixedHashMap(const FixedHashMap& other);
   FixedHashMap& operator=(const FixedHashMap& other);
   // TODO: Move constructor???
 };
 
+// GLOBAL
+template < typename KeyType, typename EntryType, usize Capacity >
+const usize FixedHashMap< KeyType, EntryType, Capacity >::bucketCount_;
+
 // constructor
 template < typename KeyType, typename EntryType, usize Capacity >
 FixedHashMap< KeyType, EntryType, Capacity >::FixedHashMap(
-    const typename HashMapInterface< KeyType, EntryType >::ElementType& init)
+    const typename FixedHashMap< KeyType, EntryType, Capacity >::ElementType& init)
     : HashMapInterface< KeyType, EntryType >(init)
+    , data_(init)
+    , tagBuffer_{}
 {
+  this->buckets_ = bucketCount_;
+  this->table_ = this->data_.array_;
+  this->tags_ = this->tagBuffer_;
 }
 
 // copy constructor
@@ -106,8 +253,15 @@ template < typename KeyType, typename EntryType, usize Capacity >
 FixedHashMap< KeyType, EntryType, Capacity >::FixedHashMap(
     const FixedHashMap< KeyType, EntryType, Capacity >& other)
     : HashMapInterface< KeyType, EntryType >(other)
+    , data_(other.init_)
+    , tagBuffer_{}
 {
-  // FIXME: copy entries and re-hash
+  // same capacity and hash functions: entries keep their slots
+  this->buckets_ = bucketCount_;
+  this->table_ = this->data_.array_;
+  this->tags_ = this->tagBuffer_;
+  std::copy(other.table_, (other.table_ + this->data_.capacity_), this->table_);
+  std::copy(other.tags_, (other.tags_ + this->data_.capacity_), this->tags_);
 }
 
 // assignement operator
@@ -116,8 +270,11 @@ FixedHashMap< KeyType, EntryType, Capacity >& FixedHashMap< KeyType, EntryType,
 operator=(const FixedHashMap< KeyType, EntryType, Capacity >& other)
 {
   this->init_ = other.init_;
-  this->data_ = {0, this->init_, nullptr};
-  // FIXME: copy entries and re-hash
+  std::copy(other.table_, (other.table_ + this->data_.capacity_), this->table_);
+  std::copy(other.tags_, (other.tags_ + this->data_.capacity_), this->tags_);
+  std::copy(other.stash_, (other.stash_ + this->stashSize_), this->stash_);
+  std::copy(other.stashTags_, (other.stashTags_ + this->stashSize_), this->stashTags_);
+  this->stashLen_ = other.stashLen_;
   this->length_ = other.length_;
 
   return *this;
@@ -127,140 +284,2006 @@ operator=(const FixedHashMap< KeyType, EntryType, Capacity >& other)
 // HashMap : dynamic hash map containter
 ///////////////////////////////////////////////////////////////////////////////
 
-// TODO: implement
+// destroy the elements of a table before its memory is released
+// NOTE: dynamic tables keep every slot constructed (free slots hold init_)
+// @param table first element of the table
+// @param count number of elements
+template < typename ElementType >
+void destroyElements(ElementType* table, const usize count)
+{
+  for(usize i = 0; i < count; i++)
+  {
+    table[i].~ElementType();
+  }
+}
+
 template < typename KeyType, typename EntryType, typename Allocator >
-struct HashMap : public HashMapInterface< KeyType, EntryType >
+struct HashMap< KeyType, EntryType, Allocator, CuckooEngine >
+    : public HashMapInterface< KeyType, EntryType >
 {
+  using ElementType = typename HashMapInterface< KeyType, EntryType >::ElementType;
+  using AllocatorType = Allocator;
+
+  Allocator& alloc_;
+  Blk memBlock_;
+  Blk tagBlock_;
+  Blk oldMemBlock_;
+  Blk oldTagBlock_;
+
+  virtual bool growTable() override;
+  virtual void releaseOldTable() override;
 
   HashMap() = delete;
-  explicit HashMap(Allocator& alloc,
-                   const typename HashMapInterface< KeyType, EntryType >::ElementType& init);
+  HashMap(Allocator& alloc, const ElementType& init, const usize Capacity);
   explicit HashMap(const HashMap& other);
   HashMap& operator=(const HashMap& other);
   // TODO: Move constructor???
+  virtual ~HashMap();
 };
 
+// virtual destructor
+template < typename KeyType, typename EntryType, typename Allocator >
+HashMap< KeyType, EntryType, Allocator >::~HashMap()
+{
+  if(this->memBlock_.ptr)
+  {
+    destroyElements(this->table_, this->buckets_ * this->bucketSlots_);
+    this->alloc_.deallocate(this->memBlock_);
+  }
+  if(this->tagBlock_.ptr)
+  {
+    this->alloc_.deallocate(this->tagBlock_);
+  }
+  this->releaseOldTable();
+}
+
+// constructor
+template < typename KeyType, typename EntryType, typename Allocator >
+HashMap< KeyType, EntryType, Allocator >::HashMap(
+    Allocator& alloc,
+    const typename HashMap< KeyType, EntryType, Allocator >::ElementType& init,
+    const usize Capacity)
+    : HashMapInterface< KeyType, EntryType >(init)
+    , alloc_{alloc}
+    , memBlock_{nullptr, 0}
+    , tagBlock_{nullptr, 0}
+    , oldMemBlock_{nullptr, 0}
+    , oldTagBlock_{nullptr, 0}
+{
+  const usize slots = this->bucketSlots_;
+  this->buckets_ = std::max(static_cast< usize >(1), (Capacity + slots - 1) / slots);
+  this->table_ = allocateType< ElementType, Allocator >(
+      this->alloc_, this->memBlock_, this->buckets_ * slots);
+  this->tags_ = allocateType< u8, Allocator >(this->alloc_, this->tagBlock_, this->buckets_ * slots);
+  std::uninitialized_fill(this->table_, (this->table_ + this->buckets_ * slots), this->init_);
+  std::fill(this->tags_, (this->tags_ + this->buckets_ * slots), 0);
+}
+
+// copy constructor
+template < typename KeyType, typename EntryType, typename Allocator >
+HashMap< KeyType, EntryType, Allocator >::HashMap(
+    const HashMap< KeyType, EntryType, Allocator >& other)
+    : HashMapInterface< KeyType, EntryType >(other)
+    , alloc_{other.alloc_}
+    , memBlock_{nullptr, 0}
+    , tagBlock_{nullptr, 0}
+    , oldMemBlock_{nullptr, 0}
+    , oldTagBlock_{nullptr, 0}
+{
+  const usize slots = this->bucketSlots_;
+  this->buckets_ = other.buckets_;
+  this->table_ = allocateType< ElementType, Allocator >(
+      this->alloc_, this->memBlock_, this->buckets_ * slots);
+  this->tags_ = allocateType< u8, Allocator >(this->alloc_, this->tagBlock_, this->buckets_ * slots);
+  std::uninitialized_copy(other.table_, (other.table_ + this->buckets_ * slots), this->table_);
+  std::copy(other.tags_, (other.tags_ + this->buckets_ * slots), this->tags_);
+  if(other.oldTable_)
+  {
+    this->oldBuckets_ = other.oldBuckets_;
+    this->migrated_ = other.migrated_;
+    this->oldTable_ = allocateType< ElementType, Allocator >(
+        this->alloc_, this->oldMemBlock_, this->oldBuckets_ * slots);
+    this->oldTags_ =
+        allocateType< u8, Allocator >(this->alloc_, this->oldTagBlock_, this->oldBuckets_ * slots);
+    std::uninitialized_copy(
+        other.oldTable_, (other.oldTable_ + this->oldBuckets_ * slots), this->oldTable_);
+    std::copy(other.oldTags_, (other.oldTags_ + this->oldBuckets_ * slots), this->oldTags_);
+  }
+}
+
+// assignement operator
+template < typename KeyType, typename EntryType, typename Allocator >
+HashMap< KeyType, EntryType, Allocator >& HashMap< KeyType, EntryType, Allocator >::
+operator=(const HashMap< KeyType, EntryType, Allocator >& other)
+{
+  if(this->memBlock_.ptr)
+  {
+    destroyElements(this->table_, this->buckets_ * this->bucketSlots_);
+    this->alloc_.deallocate(this->memBlock_);
+    this->memBlock_ = {nullptr, 0};
+  }
+  if(this->tagBlock_.ptr)
+  {
+    this->alloc_.deallocate(this->tagBlock_);
+    this->tagBlock_ = {nullptr, 0};
+  }
+  this->releaseOldTable();
+
+  const usize slots = this->bucketSlots_;
+  this->init_ = other.init_;
+  this->buckets_ = other.buckets_;
+  this->table_ = allocateType< ElementType, Allocator >(
+      this->alloc_, this->memBlock_, this->buckets_ * slots);
+  this->tags_ = allocateType< u8, Allocator >(this->alloc_, this->tagBlock_, this->buckets_ * slots);
+  std::uninitialized_copy(other.table_, (other.table_ + this->buckets_ * slots), this->table_);
+  std::copy(other.tags_, (other.tags_ + this->buckets_ * slots), this->tags_);
+  std::copy(other.stash_, (other.stash_ + this->stashSize_), this->stash_);
+  std::copy(other.stashTags_, (other.stashTags_ + this->stashSize_), this->stashTags_);
+  this->stashLen_ = other.stashLen_;
+  this->length_ = other.length_;
+  if(other.oldTable_)
+  {
+    this->oldBuckets_ = other.oldBuckets_;
+    this->migrated_ = other.migrated_;
+    this->oldTable_ = allocateType< ElementType, Allocator >(
+        this->alloc_, this->oldMemBlock_, this->oldBuckets_ * slots);
+    this->oldTags_ =
+        allocateType< u8, Allocator >(this->alloc_, this->oldTagBlock_, this->oldBuckets_ * slots);
+    std::uninitialized_copy(
+        other.oldTable_, (other.oldTable_ + this->oldBuckets_ * slots), this->oldTable_);
+    std::copy(other.oldTags_, (other.oldTags_ + this->oldBuckets_ * slots), this->oldTags_);
+  }
+
+  return *this;
+}
+
+// double the number of buckets, the current table becomes the old table
+// NOTE: does not grow while a rehash is in progress or while the container
+// is shared with concurrent readers
+// return true -> grown | false -> container can not grow now
+template < typename KeyType, typename EntryType, typename Allocator >
+bool HashMap< KeyType, EntryType, Allocator >::growTable()
+{
+  if(this->oldTable_ || this->versions_)
+  {
+    return false;
+  }
+
+  const usize slots = this->bucketSlots_;
+  const usize buckets = this->buckets_ * 2;
+  Blk memBlock = {nullptr, 0};
+  Blk tagBlock = {nullptr, 0};
+  ElementType* table =
+      allocateType< ElementType, Allocator >(this->alloc_, memBlock, buckets * slots);
+  u8* tags = allocateType< u8, Allocator >(this->alloc_, tagBlock, buckets * slots);
+  if(!table || !tags)
+  {
+    if(memBlock.ptr)
+    {
+      this->alloc_.deallocate(memBlock);
+    }
+    if(tagBlock.ptr)
+    {
+      this->alloc_.deallocate(tagBlock);
+    }
+    return false;
+  }
+  // free slots are told by their tags: trivially copyable elements are
+  // assigned straight into the raw slots so the cost of growing does not
+  // depend on the container size, other elements get their slots built
+  if(!std::is_trivially_copyable< ElementType >::value)
+  {
+    std::uninitialized_fill(table, (table + buckets * slots), this->init_);
+  }
+  std::fill(tags, (tags + buckets * slots), 0);
+
+  this->oldTable_ = this->table_;
+  this->oldTags_ = this->tags_;
+  this->oldBuckets_ = this->buckets_;
+  this->oldMemBlock_ = this->memBlock_;
+  this->oldTagBlock_ = this->tagBlock_;
+  this->migrated_ = 0;
+  this->table_ = table;
+  this->tags_ = tags;
+  this->buckets_ = buckets;
+  this->memBlock_ = memBlock;
+  this->tagBlock_ = tagBlock;
+  return true;
+}
+
+// release the old table
+template < typename KeyType, typename EntryType, typename Allocator >
+void HashMap< KeyType, EntryType, Allocator >::releaseOldTable()
+{
+  if(this->oldMemBlock_.ptr)
+  {
+    destroyElements(this->oldTable_, this->oldBuckets_ * this->bucketSlots_);
+    this->alloc_.deallocate(this->oldMemBlock_);
+    this->oldMemBlock_ = {nullptr, 0};
+  }
+  if(this->oldTagBlock_.ptr)
+  {
+    this->alloc_.deallocate(this->oldTagBlock_);
+    this->oldTagBlock_ = {nullptr, 0};
+  }
+  this->oldTable_ = nullptr;
+  this->oldTags_ = nullptr;
+  this->oldBuckets_ = 0;
+  this->migrated_ = 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
-// Accessors
+// Cuckoo helpers
 ///////////////////////////////////////////////////////////////////////////////
 
-// HashMap acessor functions
-// ----------------------------------------------------------------------------
+// map a hash lane into a bucket index
+// NOTE: multiply-shift range reduction of the lane's lower 32 bits,
+// it avoids the division of a modulus and needs buckets < 2^32
+// @param h       hash lane
+// @param buckets number of buckets
+// @return bucket index
+constexpr usize bucketIndex(const u64 h, const usize buckets)
+{
+  return static_cast< usize >(((h & 0xffffffff) * buckets) >> 32);
+}
 
-// length of the container
-// @param   container
-// @return  size
-template < typename KeyType, typename EntryType >
-inline usize len(HashMapInterface< KeyType, EntryType >& container)
+// 8 bit fingerprint of a key
+// NOTE: taken from the top bits of lane 0 (bucketIndex only uses the lower
+// 32 bits of a lane), 0 is reserved to mark free slots
+// @param hashes hashes of the key
+// @return key tag
+constexpr u8 hashTag(const Hashes& hashes)
 {
-  return container.length_;
+  const u8 tag = static_cast< u8 >(hashes.h[0] >> 56);
+  return tag ? tag : 0x01;
 }
 
-// clear the container
-// @param container
-template < typename KeyType, typename EntryType >
-inline void clear(HashMapInterface< KeyType, EntryType >& container)
+// compare a whole bucket of tags against tag
+// @param tags first tag of the bucket
+// @param tag  tag to look for
+// @return bit mask with one bit set per matching slot
+template < usize slots >
+inline u32 matchTags(const u8* tags, const u8 tag)
 {
-  clear(container.data_);
-  container.length_ = 0;
+  static_assert(slots == 4 || slots == 8, "buckets have 4 or 8 slots");
+  u64 group = 0;
+  std::memcpy(&group, tags, slots);
+#if defined(__SSE2__)
+  const __m128i cmp = _mm_cmpeq_epi8(_mm_loadl_epi64(reinterpret_cast< const __m128i* >(&group)),
+                                     _mm_set1_epi8(static_cast< char >(tag)));
+  return static_cast< u32 >(_mm_movemask_epi8(cmp)) & ((1u << slots) - 1);
+#else
+  // SWAR: set the high bit of every byte equal to tag, then gather those bits
+  const u64 low7 = 0x7f7f7f7f7f7f7f7fULL;
+  const u64 x = group ^ (0x0101010101010101ULL * tag);
+  const u64 zero = ~(((x & low7) + low7) | x | low7);
+  return static_cast< u32 >(((zero >> 7) * 0x0102040810204080ULL) >> 56) & ((1u << slots) - 1);
+#endif
 }
 
-// count number of elements that have key
+// search the candidate buckets and the stash for the element holding key
 // @param container container to access
-// @param key       key of element to access
-// return pointer to the element at the container required position
-template < typename KeyType, typename EntryType >
-inline usize count(HashMapInterface< KeyType, EntryType >& container, const KeyType& key)
+// @param key       key of element to access (or a probe that compares with it)
+// @param hashes    hashes of the key
+// return pointer to the element or nullptr if key is not in the container
+template < typename KeyType, typename EntryType, typename ProbeType >
+inline typename HashMapInterface< KeyType, EntryType >::ElementType* findElement(
+    HashMapInterface< KeyType, EntryType >& container, const ProbeType& key, const Hashes& hashes)
 {
-  if(container.length_)
+  using ElementType = typename HashMapInterface< KeyType, EntryType >::ElementType;
+  const usize slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+  const u8 tag = hashTag(hashes);
+
+  for(u8 i = 0; i < 3; i++)
   {
-    // TODO: find all the element
-    // return // some value;
+    const usize first = bucketIndex(hashes.h[i], container.buckets_) * slots;
+    for(u32 match = matchTags< slots >(container.tags_ + first, tag); match; match &= match - 1)
+    {
+      ElementType* el = container.table_ + first + countTrailingZeros(match);
+      if(el->key == key)
+      {
+        return el;
+      }
+    }
   }
-  return 0;
+
+  // not migrated yet
+  if(container.oldTable_)
+  {
+    for(u8 i = 0; i < 3; i++)
+    {
+      const usize first = bucketIndex(hashes.h[i], container.oldBuckets_) * slots;
+      for(u32 match = matchTags< slots >(container.oldTags_ + first, tag); match;
+          match &= match - 1)
+      {
+        ElementType* el = container.oldTable_ + first + countTrailingZeros(match);
+        if(el->key == key)
+        {
+          return el;
+        }
+      }
+    }
+  }
+
+  for(usize s = 0; s < container.stashLen_; s++)
+  {
+    if(container.stashTags_[s] == tag && container.stash_[s].key == key)
+    {
+      return (container.stash_ + s);
+    }
+  }
+  return nullptr;
 }
 
-// random accessor
+// version counter that guards a bucket
+// @param bucket bucket index
+// @return counter index
+inline usize versionStripe(const usize bucket)
+{
+  return bucket & (HashMapVersions::stripes_ - 1);
+}
+
+// mark the start of a write to (up to) two stripes
+// NOTE: a stripe shared by both is only counted once, so it ends up even again
+// @param versions version counters (nullptr: no concurrent readers)
+// @param a        first stripe
+// @param b        second stripe
+inline void beginWrite(HashMapVersions* versions, const usize a, const usize b)
+{
+  if(versions)
+  {
+    versions->counters_[a].store(versions->counters_[a].load(std::memory_order_relaxed) + 1,
+                                 std::memory_order_relaxed);
+    if(b != a)
+    {
+      versions->counters_[b].store(versions->counters_[b].load(std::memory_order_relaxed) + 1,
+                                   std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+}
+
+// mark the end of a write to (up to) two stripes
+// @param versions version counters (nullptr: no concurrent readers)
+// @param a        first stripe
+// @param b        second stripe
+inline void endWrite(HashMapVersions* versions, const usize a, const usize b)
+{
+  if(versions)
+  {
+    versions->counters_[a].store(versions->counters_[a].load(std::memory_order_relaxed) + 1,
+                                 std::memory_order_release);
+    if(b != a)
+    {
+      versions->counters_[b].store(versions->counters_[b].load(std::memory_order_relaxed) + 1,
+                                   std::memory_order_release);
+    }
+  }
+}
+
+// version counter that guards an element of the table or of the stash
 // @param container container to access
-// @param key       key of element to access
-// return pointer to the element at the container required position
+// @param el        element
+// @return counter index
 template < typename KeyType, typename EntryType >
-inline EntryType* find(HashMapInterface< KeyType, EntryType >& container, const KeyType& key)
+inline usize elementStripe(const HashMapInterface< KeyType, EntryType >& container,
+                           const typename HashMapInterface< KeyType, EntryType >::ElementType* el)
 {
-  if(container.length_)
+  if(el >= container.stash_ && el < (container.stash_ + container.stashSize_))
   {
-    // TODO: find the entry
-    // return // some pointer;
+    return HashMapVersions::stripes_;
   }
-  return nullptr;
+  return versionStripe((el - container.table_) / container.bucketSlots_);
+}
+
+// node of the breadth first search for a displacement path
+struct CuckooPathNode
+{
+  usize bucket; // bucket visited
+  i32 parent;   // node holding the element that moves into this bucket (-1 on roots)
+  u8 slot;      // slot of that element in the parent bucket
+  u8 depth;     // number of moves to get here
+};
+
+// check whether a bucket is already part of the path ending at node
+// @param path  search nodes
+// @param node  last node of the path
+// @param bucket bucket to check
+// return true -> on path | false -> not on path
+inline bool onCuckooPath(const CuckooPathNode* path, i32 node, const usize bucket)
+{
+  for(; node >= 0; node = path[node].parent)
+  {
+    if(path[node].bucket == bucket)
+    {
+      return true;
+    }
+  }
+  return false;
 }
 
-// add a new element to the key
+// place element into the table, displacing other elements if needed.
+// a bounded breadth first search looks for the shortest path from one of
+// the element candidate buckets to a free slot, then the elements along
+// the path are moved from its end backwards, so no element is ever
+// out of the table while moving.
 // @param container container to access
-// @param key       key of element to access
-// @param entry     element content
-// return pointer to the element at the container required position
+// @param element   element to place (its key is not in the container)
+// @param hashes    hashes of the element key
+// return true -> placed | false -> no path found (table left untouched)
 template < typename KeyType, typename EntryType >
-inline bool emplace(HashMapInterface< KeyType, EntryType >& container,
-                    const KeyType& key,
-                    const EntryType& entry)
+bool cuckooPlace(HashMapInterface< KeyType, EntryType >& container,
+                 const typename HashMapInterface< KeyType, EntryType >::ElementType& element,
+                 const Hashes& hashes)
 {
-  const usize cap = container.data_.capacity();
-  if(container.length_ < cap)
+  const usize slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+  const usize maxSearch = HashMapInterface< KeyType, EntryType >::maxSearch_;
+
+  CuckooPathNode path[maxSearch];
+  usize tail = 0;
+
+  for(u8 i = 0; i < 3; i++)
   {
-    // TODO: insert the entry
-    typename HashMapInterface< KeyType, EntryType >::ElementType el;
-    el.key = key;
-    el.value = entry;
-    Hashes hash01 = hash(key);
+    path[tail++] = {bucketIndex(hashes.h[i], container.buckets_), -1, 0, 0};
+  }
 
-    for(u8 i = 0; i < 3; i++)
+  // visit the buckets in breadth first order
+  for(usize node = 0; node < tail; node++)
+  {
+    const usize first = path[node].bucket * slots;
+    const u32 free = matchTags< slots >(container.tags_ + first, 0);
+    if(free)
     {
-      u32 k = hash01.h[i] % cap;
-      typename HashMapInterface< KeyType, EntryType >::ElementType& old =
-          Deref(at(container.data_, k));
-      if(old.key == container.init_.key)
+      // shift the elements along the path, last one first
+      usize freeSlot = countTrailingZeros(free);
+      i32 cur = static_cast< i32 >(node);
+      while(path[cur].parent >= 0)
       {
-        // free slot add item and break loop
-
-        return true;
+        const usize dst = path[cur].bucket * slots + freeSlot;
+        const usize src = path[path[cur].parent].bucket * slots + path[cur].slot;
+        const usize dstStripe = versionStripe(path[cur].bucket);
+        const usize srcStripe = versionStripe(path[path[cur].parent].bucket);
+        beginWrite(container.versions_, dstStripe, srcStripe);
+        container.table_[dst] = container.table_[src];
+        container.tags_[dst] = container.tags_[src];
+        endWrite(container.versions_, dstStripe, srcStripe);
+        freeSlot = path[cur].slot;
+        cur = path[cur].parent;
       }
-      else if(old.key == key)
-      {
-        // slot is taken by previous entry for this key
-        // overwrite and break loop
+      const usize dst = path[cur].bucket * slots + freeSlot;
+      const usize dstStripe = versionStripe(path[cur].bucket);
+      beginWrite(container.versions_, dstStripe, dstStripe);
+      container.table_[dst] = element;
+      container.tags_[dst] = hashTag(hashes);
+      endWrite(container.versions_, dstStripe, dstStripe);
+      return true;
+    }
 
-        return true;
-      }
-      else if(old.key != key)
+    // expand: the elements of this bucket may move to their other buckets
+    if(path[node].depth >= container.maxPathLen_)
+    {
+      continue;
+    }
+    for(usize s = 0; s < slots && tail < maxSearch; s++)
+    {
+      const Hashes alt = hash(container.table_[first + s].key);
+      for(u8 i = 0; i < 3 && tail < maxSearch; i++)
       {
-        // slot is taken by entry with different key key
-        // continue loop to try next hash
+        const usize b = bucketIndex(alt.h[i], container.buckets_);
+        if(!onCuckooPath(path, static_cast< i32 >(node), b))
+        {
+          path[tail++] = {b,
+                          static_cast< i32 >(node),
+                          static_cast< u8 >(s),
+                          static_cast< u8 >(path[node].depth + 1)};
+        }
+      }
+    }
+  }
+  return false;
+}
 
-        continue;
+// move stashed elements back into the table when there is room for them
+// @param container container to access
+template < typename KeyType, typename EntryType >
+void drainStash(HashMapInterface< KeyType, EntryType >& container)
+{
+  usize s = 0;
+  while(s < container.stashLen_)
+  {
+    if(cuckooPlace(container, container.stash_[s], hash(container.stash_[s].key)))
+    {
+      beginWrite(container.versions_, HashMapVersions::stripes_, HashMapVersions::stripes_);
+      --container.stashLen_;
+      container.stash_[s] = container.stash_[container.stashLen_];
+      container.stashTags_[s] = container.stashTags_[container.stashLen_];
+      container.stash_[container.stashLen_] = container.init_;
+      container.stashTags_[container.stashLen_] = 0;
+      endWrite(container.versions_, HashMapVersions::stripes_, HashMapVersions::stripes_);
+    }
+    else
+    {
+      ++s;
+    }
+  }
+}
+
+// move the next few buckets of the old table into the table
+// NOTE: elements that find no room go to the stash, when the stash is full
+// the migration stops at that bucket until removals make room
+// @param container container to access
+// return true -> progress made | false -> migration is stuck
+template < typename KeyType, typename EntryType >
+bool migrateBuckets(HashMapInterface< KeyType, EntryType >& container)
+{
+  const usize slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+  bool progress = false;
+
+  for(usize n = 0; n < container.migrateStep_ && container.migrated_ < container.oldBuckets_; n++)
+  {
+    const usize first = container.migrated_ * slots;
+    for(usize s = 0; s < slots; s++)
+    {
+      if(container.oldTags_[first + s])
+      {
+        const typename HashMapInterface< KeyType, EntryType >::ElementType& el =
+            container.oldTable_[first + s];
+        const Hashes hashes = hash(el.key);
+        if(!cuckooPlace(container, el, hashes))
+        {
+          if(container.stashLen_ == container.stashSize_)
+          {
+            return progress;
+          }
+          container.stashTags_[container.stashLen_] = hashTag(hashes);
+          container.stash_[container.stashLen_++] = el;
+        }
+        container.oldTable_[first + s] = container.init_;
+        container.oldTags_[first + s] = 0;
+        progress = true;
       }
     }
+    ++container.migrated_;
+    progress = true;
+  }
+
+  if(container.migrated_ == container.oldBuckets_)
+  {
+    container.releaseOldTable();
+  }
+  return progress;
+}
+
+// add an element whose key hashes are already known
+// @param container container to access
+// @param key       key of element to access
+// @param entry     element content
+// @param hashes    hashes of the key
+// return true -> inserted | false -> container is full
+template < typename KeyType, typename EntryType >
+bool emplaceElement(HashMapInterface< KeyType, EntryType >& container,
+                    const KeyType& key,
+                    const EntryType& entry,
+                    const Hashes& hashes)
+{
+  if(container.oldTable_ && !container.versions_)
+  {
+    migrateBuckets(container);
+  }
+
+  typename HashMapInterface< KeyType, EntryType >::ElementType* old =
+      findElement(container, key, hashes);
+  if(old)
+  {
+    const usize stripe = elementStripe(container, old);
+    beginWrite(container.versions_, stripe, stripe);
+    old->value = entry;
+    endWrite(container.versions_, stripe, stripe);
+    return true;
+  }
 
-    // if we got to this point without find a place for the item
-    // we'll need to move things around!
-    // TODO
+  // grow before the table is so full that insertions get slow
+  const usize tableSlots = container.buckets_ * container.bucketSlots_;
+  if(!container.oldTable_ && container.length_ * 100 >= tableSlots * container.maxLoad_)
+  {
+    container.growTable();
+  }
+
+  const typename HashMapInterface< KeyType, EntryType >::ElementType el = {key, entry};
+  if(cuckooPlace(container, el, hashes))
+  {
+    ++container.length_;
+    return true;
+  }
+  if(!container.oldTable_ && container.growTable() && cuckooPlace(container, el, hashes))
+  {
+    ++container.length_;
+    return true;
+  }
+  if(container.stashLen_ < container.stashSize_)
+  {
+    beginWrite(container.versions_, HashMapVersions::stripes_, HashMapVersions::stripes_);
+    container.stashTags_[container.stashLen_] = hashTag(hashes);
+    container.stash_[container.stashLen_++] = el;
+    endWrite(container.versions_, HashMapVersions::stripes_, HashMapVersions::stripes_);
+    ++container.length_;
+    return true;
   }
   return false;
 }
 
-// remove an element from container
+// prefetch the candidate buckets (tags and slots) of a key
 // @param container container to access
-// @param key       key of element to remove
-// return pointer to the element at the container required position
+// @param hashes    hashes of the key
 template < typename KeyType, typename EntryType >
-inline bool remove(HashMapInterface< KeyType, EntryType >& container, KeyType key)
+inline void prefetchBuckets(HashMapInterface< KeyType, EntryType >& container,
+                            const Hashes& hashes)
 {
-  if(container.length_)
+  const usize slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+  for(u8 i = 0; i < 3; i++)
   {
-    // TODO: remove the entry
-    // return // some value;
+    const usize first = bucketIndex(hashes.h[i], container.buckets_) * slots;
+    prefetch(container.tags_ + first);
+    prefetch(container.table_ + first);
+    prefetch(reinterpret_cast< const u8* >(container.table_ + first + slots) - 1);
   }
-  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Accessors
+///////////////////////////////////////////////////////////////////////////////
+
+// HashMap acessor functions
+// ----------------------------------------------------------------------------
+
+// length of the container
+// @param   container
+// @return  size
+template < typename KeyType, typename EntryType >
+inline usize len(HashMapInterface< KeyType, EntryType >& container)
+{
+  return container.length_;
+}
+
+// number of elements the container can hold (table slots + stash)
+// NOTE: cuckoo insertions may fail before the table is completely full
+// @param   container
+// @return  capacity
+template < typename KeyType, typename EntryType >
+inline usize capacity(HashMapInterface< KeyType, EntryType >& container)
+{
+  return container.buckets_ * container.bucketSlots_ + container.stashSize_;
+}
+
+// clear the container
+// @param container
+template < typename KeyType, typename EntryType >
+inline void clear(HashMapInterface< KeyType, EntryType >& container)
+{
+  for(usize s = 0; s <= HashMapVersions::stripes_; s++)
+  {
+    beginWrite(container.versions_, s, s);
+  }
+  std::fill(container.table_,
+            (container.table_ + container.buckets_ * container.bucketSlots_),
+            container.init_);
+  std::fill(container.tags_, (container.tags_ + container.buckets_ * container.bucketSlots_), 0);
+  std::fill(container.stash_, (container.stash_ + container.stashSize_), container.init_);
+  std::fill(container.stashTags_, (container.stashTags_ + container.stashSize_), 0);
+  container.stashLen_ = 0;
+  container.length_ = 0;
+  if(container.oldTable_)
+  {
+    container.releaseOldTable();
+  }
+  for(usize s = 0; s <= HashMapVersions::stripes_; s++)
+  {
+    endWrite(container.versions_, s, s);
+  }
+}
+
+// count number of elements that have key
+// @param container container to access
+// @param key       key of element to access
+// return number of elements with key (keys are unique: 0 or 1)
+template < typename KeyType, typename EntryType, typename ProbeType >
+inline usize count(HashMapInterface< KeyType, EntryType >& container, const ProbeType& key)
+{
+  if(container.length_)
+  {
+    return findElement(container, key, hashAs< KeyType >(key)) ? 1 : 0;
+  }
+  return 0;
+}
+
+// random accessor
+// NOTE: key may be of another type than KeyType (heterogeneous lookup) as long
+// as Hasher< KeyType > hashes it the same way and it compares with KeyType,
+// e.g. a StaticString (characters and length) looks up StringWrapper keys
+// without building a string in the pool
+// @param container container to access
+// @param key       key of element to access
+// return pointer to the element at the container required position
+template < typename KeyType, typename EntryType, typename ProbeType >
+inline EntryType* find(HashMapInterface< KeyType, EntryType >& container, const ProbeType& key)
+{
+  if(container.length_)
+  {
+    typename HashMapInterface< KeyType, EntryType >::ElementType* el =
+        findElement(container, key, hashAs< KeyType >(key));
+    if(el)
+    {
+      return &(el->value);
+    }
+  }
+  return nullptr;
+}
+
+// add a new element to the key (overwrites the entry if key is present)
+// @param container container to access
+// @param key       key of element to access
+// @param entry     element content
+// return true -> inserted | false -> container is full
+template < typename KeyType, typename EntryType >
+inline bool emplace(HashMapInterface< KeyType, EntryType >& container,
+                    const KeyType& key,
+                    const EntryType& entry)
+{
+  return emplaceElement(container, key, entry, hash(key));
+}
+
+// remove an element from container
+// NOTE: key may be a probe of another type, as with find
+// @param container container to access
+// @param key       key of element to remove
+// return true -> removed | false -> key not found
+template < typename KeyType, typename EntryType, typename ProbeType >
+inline bool remove(HashMapInterface< KeyType, EntryType >& container, const ProbeType& key)
+{
+  if(container.oldTable_ && !container.versions_)
+  {
+    migrateBuckets(container);
+  }
+  if(container.length_)
+  {
+    typename HashMapInterface< KeyType, EntryType >::ElementType* el =
+        findElement(container, key, hashAs< KeyType >(key));
+    if(el)
+    {
+      const usize stripe = elementStripe(container, el);
+      beginWrite(container.versions_, stripe, stripe);
+      *el = container.init_;
+      --container.length_;
+      if(el >= container.stash_ && el < (container.stash_ + container.stashSize_))
+      {
+        // keep the stash packed
+        const usize s = el - container.stash_;
+        --container.stashLen_;
+        std::swap(*el, container.stash_[container.stashLen_]);
+        container.stashTags_[s] = container.stashTags_[container.stashLen_];
+        container.stashTags_[container.stashLen_] = 0;
+      }
+      else if(el >= container.table_ &&
+              el < (container.table_ + container.buckets_ * container.bucketSlots_))
+      {
+        container.tags_[el - container.table_] = 0;
+      }
+      else
+      {
+        container.oldTags_[el - container.oldTable_] = 0;
+      }
+      endWrite(container.versions_, stripe, stripe);
+      if(container.stashLen_)
+      {
+        drainStash(container);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+// HashMap concurrent read functions
+// NOTE: one writer thread may keep using emplace / remove / clear (and the
+// batch versions) while any number of reader threads use concurrentFind.
+// readers are optimistic: they snapshot the version counters of the key
+// candidate buckets and of the stash, copy the element out and retry when
+// a counter changed. len, find and count are not safe to call concurrently.
+// ----------------------------------------------------------------------------
+
+// share a container with concurrent readers
+// NOTE: concurrent readers only probe the table and the stash, so a rehash in
+// progress is finished first. migration stalls when the stash is full, the
+// stash is then drained into the table to make room for the stalled elements.
+// @param container container to share
+// @param versions  version counters (must outlive the sharing)
+// return true -> shared | false -> the rehash could not finish, not shared
+template < typename KeyType, typename EntryType >
+inline bool shareReads(HashMapInterface< KeyType, EntryType >& container,
+                       HashMapVersions& versions)
+{
+  while(container.oldTable_)
+  {
+    if(!migrateBuckets(container))
+    {
+      const usize stashLen = container.stashLen_;
+      drainStash(container);
+      if(container.stashLen_ == stashLen)
+      {
+        break;
+      }
+    }
+  }
+  assert(!container.oldTable_ && "shareReads: old table elements fit nowhere");
+  if(container.oldTable_)
+  {
+    return false;
+  }
+
+  for(usize s = 0; s <= HashMapVersions::stripes_; s++)
+  {
+    versions.counters_[s].store(0, std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  container.versions_ = &versions;
+  return true;
+}
+
+// stop sharing a container (no reader may be running)
+// @param container container to access
+template < typename KeyType, typename EntryType >
+inline void unshareReads(HashMapInterface< KeyType, EntryType >& container)
+{
+  container.versions_ = nullptr;
+}
+
+// lock free random accessor, safe against one concurrent writer
+// @param container container to access (shared with shareReads)
+// @param key       key of element to access
+// @param out       receives a copy of the key entry
+// return true -> found | false -> key not found
+template < typename KeyType, typename EntryType >
+bool concurrentFind(HashMapInterface< KeyType, EntryType >& container,
+                    const KeyType& key,
+                    EntryType& out)
+{
+  static_assert(std::is_trivially_copyable< KeyType >::value &&
+                    std::is_trivially_copyable< EntryType >::value,
+                "concurrent reads copy elements that may be changing");
+  using ElementType = typename HashMapInterface< KeyType, EntryType >::ElementType;
+  const usize slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+  const usize stashSize = HashMapInterface< KeyType, EntryType >::stashSize_;
+
+  std::atomic< u32 >* counters = container.versions_->counters_;
+  const Hashes hashes = hash(key);
+  const u8 tag = hashTag(hashes);
+  usize first[3];
+  usize stripes[4];
+  for(u8 i = 0; i < 3; i++)
+  {
+    first[i] = bucketIndex(hashes.h[i], container.buckets_) * slots;
+    stripes[i] = versionStripe(first[i] / slots);
+  }
+  stripes[3] = HashMapVersions::stripes_;
+
+  for(;;)
+  {
+    u32 before[4];
+    bool writing = false;
+    for(u8 i = 0; i < 4; i++)
+    {
+      before[i] = counters[stripes[i]].load(std::memory_order_acquire);
+      writing = writing || (before[i] & 1);
+    }
+    if(writing)
+    {
+      continue;
+    }
+
+    bool found = false;
+    ElementType el = container.init_;
+    for(u8 i = 0; i < 3 && !found; i++)
+    {
+      u8 tags[slots];
+      std::memcpy(tags, container.tags_ + first[i], slots);
+      for(u32 match = matchTags< slots >(tags, tag); match && !found; match &= match - 1)
+      {
+        std::memcpy(&el, container.table_ + first[i] + countTrailingZeros(match), sizeof(el));
+        found = (el.key == key);
+      }
+    }
+    for(usize s = 0; s < stashSize && !found; s++)
+    {
+      if(container.stashTags_[s] == tag)
+      {
+        std::memcpy(&el, container.stash_ + s, sizeof(el));
+        found = (el.key == key);
+      }
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    bool changed = false;
+    for(u8 i = 0; i < 4; i++)
+    {
+      changed = changed || (counters[stripes[i]].load(std::memory_order_relaxed) != before[i]);
+    }
+    if(!changed)
+    {
+      if(found)
+      {
+        out = el.value;
+      }
+      return found;
+    }
+  }
+}
+
+// HashMap batch acessor functions
+// NOTE: keys are processed in groups: all the keys of a group are hashed,
+// their candidate buckets prefetched and only then probed, so the cache
+// misses of independent keys overlap instead of being paid one at a time
+// ----------------------------------------------------------------------------
+
+// number of keys hashed and prefetched ahead of probing
+GLOBAL const usize hashMapBatchGroup = 8;
+
+// random accessor for a batch of keys
+// @param container container to access
+// @param keys      keys of the elements to access
+// @param n         number of keys
+// @param out       pointer to each key entry (nullptr when not found)
+// return number of keys found
+template < typename KeyType, typename EntryType, typename Engine >
+usize findBatch(HashMapInterface< KeyType, EntryType, Engine >& container,
+                const KeyType* keys,
+                const usize n,
+                EntryType** out)
+{
+  Hashes hashes[hashMapBatchGroup];
+  usize found = 0;
+
+  for(usize first = 0; first < n; first += hashMapBatchGroup)
+  {
+    const usize group = std::min(hashMapBatchGroup, n - first);
+    hashBatch(keys + first, group, hashes);
+    for(usize i = 0; i < group; i++)
+    {
+      prefetchBuckets(container, hashes[i]);
+    }
+    for(usize i = 0; i < group; i++)
+    {
+      typename HashMapInterface< KeyType, EntryType, Engine >::ElementType* el =
+          container.length_ ? findElement(container, keys[first + i], hashes[i]) : nullptr;
+      out[first + i] = el ? &(el->value) : nullptr;
+      found += el ? 1 : 0;
+    }
+  }
+  return found;
+}
+
+// add a batch of elements (overwrites the entries of keys already present)
+// @param container container to access
+// @param keys      keys of the elements
+// @param entries   content of each element
+// @param n         number of elements
+// return number of elements inserted (smaller than n when the container is full)
+template < typename KeyType, typename EntryType, typename Engine >
+usize emplaceBatch(HashMapInterface< KeyType, EntryType, Engine >& container,
+                   const KeyType* keys,
+                   const EntryType* entries,
+                   const usize n)
+{
+  Hashes hashes[hashMapBatchGroup];
+  usize inserted = 0;
+
+  for(usize first = 0; first < n; first += hashMapBatchGroup)
+  {
+    const usize group = std::min(hashMapBatchGroup, n - first);
+    hashBatch(keys + first, group, hashes);
+    for(usize i = 0; i < group; i++)
+    {
+      prefetchBuckets(container, hashes[i]);
+    }
+    for(usize i = 0; i < group; i++)
+    {
+      if(emplaceElement(container, keys[first + i], entries[first + i], hashes[i]))
+      {
+        ++inserted;
+      }
+    }
+  }
+  return inserted;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// StaticHashMap : hash map built at compile time
+///////////////////////////////////////////////////////////////////////////////
+
+// smallest power of 2 number of slots that keeps capacity elements under 7/8 load
+// @param capacity number of elements
+// @return number of slots
+constexpr usize staticSlotCount(const usize capacity)
+{
+  usize slots = 1;
+  while(slots * 7 < capacity * 8)
+  {
+    slots *= 2;
+  }
+  return slots;
+}
+
+// flat linear probing table with no virtual functions and no allocation:
+// a literal type, so a constexpr StaticHashMap is filled at compile time
+// (from an initializer list) and lives in read only data.
+// a key is looked for from the slot picked by lane 1, comparing the 8 bit
+// tags (top of lane 0) before the keys, until the key or a free slot is found.
+// NOTE: needs keys and entries that are literal types with a constexpr
+// Hasher (integers, enums, StaticString, pairs and tuples of them).
+// elements can not be removed (tables are meant to be built once).
+template < typename KeyType, typename EntryType, usize Capacity >
+struct StaticHashMap
+{
+  struct ElementType
+  {
+    KeyType key;
+    EntryType value;
+  };
+
+  // number of slots (power of 2)
+  GLOBAL const usize slots_{staticSlotCount(Capacity)};
+
+  ElementType table_[slots_];
+  u8 tags_[slots_];
+  usize length_;
+
+  constexpr StaticHashMap();
+  constexpr StaticHashMap(std::initializer_list< ElementType > elements);
+};
+
+// GLOBAL
+template < typename KeyType, typename EntryType, usize Capacity >
+const usize StaticHashMap< KeyType, EntryType, Capacity >::slots_;
+
+// StaticHashMap acessor functions
+// ----------------------------------------------------------------------------
+
+// length of the container
+// @param   container
+// @return  size
+template < typename KeyType, typename EntryType, usize Capacity >
+constexpr usize len(const StaticHashMap< KeyType, EntryType, Capacity >& container)
+{
+  return container.length_;
+}
+
+// number of elements the container can hold
+// @param   container
+// @return  capacity
+template < typename KeyType, typename EntryType, usize Capacity >
+constexpr usize capacity(const StaticHashMap< KeyType, EntryType, Capacity >&)
+{
+  return Capacity;
+}
+
+// random accessor
+// @param container container to access
+// @param key       key of element to access
+// return pointer to the element entry or nullptr if key is not in the container
+template < typename KeyType, typename EntryType, usize Capacity >
+constexpr const EntryType* find(const StaticHashMap< KeyType, EntryType, Capacity >& container,
+                                const KeyType& key)
+{
+  const usize mask = StaticHashMap< KeyType, EntryType, Capacity >::slots_ - 1;
+  const Hashes hashes = hash(key);
+  const u8 tag = hashTag(hashes);
+
+  usize pos = hashes.h[1] & mask;
+  for(usize n = 0; n <= mask && container.tags_[pos]; n++)
+  {
+    if(container.tags_[pos] == tag && container.table_[pos].key == key)
+    {
+      return &(container.table_[pos].value);
+    }
+    pos = (pos + 1) & mask;
+  }
+  return nullptr;
+}
+
+// count number of elements that have key
+// @param container container to access
+// @param key       key of element to access
+// return number of elements with key (keys are unique: 0 or 1)
+template < typename KeyType, typename EntryType, usize Capacity >
+constexpr usize count(const StaticHashMap< KeyType, EntryType, Capacity >& container,
+                      const KeyType& key)
+{
+  return find(container, key) ? 1 : 0;
+}
+
+// add a new element to the key (overwrites the entry if key is present)
+// @param container container to access
+// @param key       key of element to access
+// @param entry     element content
+// return true -> inserted | false -> container is full
+template < typename KeyType, typename EntryType, usize Capacity >
+constexpr bool emplace(StaticHashMap< KeyType, EntryType, Capacity >& container,
+                       const KeyType& key,
+                       const EntryType& entry)
+{
+  const usize mask = StaticHashMap< KeyType, EntryType, Capacity >::slots_ - 1;
+  const Hashes hashes = hash(key);
+  const u8 tag = hashTag(hashes);
+
+  usize pos = hashes.h[1] & mask;
+  for(usize n = 0; n <= mask; n++)
+  {
+    if(!container.tags_[pos])
+    {
+      if(container.length_ == Capacity)
+      {
+        return false;
+      }
+      container.table_[pos] = {key, entry};
+      container.tags_[pos] = tag;
+      ++container.length_;
+      return true;
+    }
+    if(container.tags_[pos] == tag && container.table_[pos].key == key)
+    {
+      container.table_[pos].value = entry;
+      return true;
+    }
+    pos = (pos + 1) & mask;
+  }
+  return false;
+}
+
+// default constructor
+template < typename KeyType, typename EntryType, usize Capacity >
+constexpr StaticHashMap< KeyType, EntryType, Capacity >::StaticHashMap()
+    : table_{}
+    , tags_{}
+    , length_(0)
+{
+}
+
+// initializer list constructor
+// NOTE: more elements than Capacity fail the assertion (a compile error
+// when the map is constexpr)
+template < typename KeyType, typename EntryType, usize Capacity >
+constexpr StaticHashMap< KeyType, EntryType, Capacity >::StaticHashMap(
+    std::initializer_list< typename StaticHashMap< KeyType, EntryType, Capacity >::ElementType >
+        elements)
+    : table_{}
+    , tags_{}
+    , length_(0)
+{
+  for(const ElementType& el : elements)
+  {
+    const bool placed = emplace(*this, el.key, el.value);
+    assert(placed);
+    (void)placed;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PerfectHashMap : minimal perfect hash map of a key set known at build time
+///////////////////////////////////////////////////////////////////////////////
+
+// every key is hashed into one of Size buckets by lane 0, each bucket has a
+// pilot (found when the map is built) that displaces lane 1 so the keys of
+// the bucket land on free slots: Size keys fill exactly Size slots and a
+// lookup is one hash, one pilot load and one key comparison (PTHash style).
+// the buckets are placed largest first, trying pilots until one fits.
+// NOTE: built by the constexpr constructor, so a constexpr map costs nothing
+// at run time; keys need a constexpr Hasher (see StaticHashMap) and must be
+// unique, duplicated keys (or a pilot search that runs out) fail an assertion.
+template < typename KeyType, typename EntryType, usize Size >
+struct PerfectHashMap
+{
+  static_assert(Size > 0, "perfect hash maps hold at least one key");
+  static_assert(Size < (1ULL << 32), "bucketIndex maps into less than 2^32 slots");
+
+  struct ElementType
+  {
+    KeyType key;
+    EntryType value;
+  };
+
+  // max number of pilots tried for one bucket
+  GLOBAL const u32 maxPilot_{1u << 20};
+
+  ElementType table_[Size];
+  u64 pilots_[Size]; // mixed pilot of each bucket
+
+  PerfectHashMap() = delete;
+  constexpr PerfectHashMap(std::initializer_list< ElementType > elements);
+};
+
+// GLOBAL
+template < typename KeyType, typename EntryType, usize Size >
+const u32 PerfectHashMap< KeyType, EntryType, Size >::maxPilot_;
+
+// constructor: builds the pilots for the given elements
+// @param elements exactly Size elements with unique keys
+template < typename KeyType, typename EntryType, usize Size >
+constexpr PerfectHashMap< KeyType, EntryType, Size >::PerfectHashMap(
+    std::initializer_list< typename PerfectHashMap< KeyType, EntryType, Size >::ElementType >
+        elements)
+    : table_{}
+    , pilots_{}
+{
+  assert(elements.size() == Size);
+  const ElementType* input = elements.begin();
+
+  // hash every key once, then group the keys by bucket (counting sort)
+  u64 lanes[Size] = {};
+  usize bucketOf[Size] = {};
+  usize bucketLen[Size] = {};
+  usize bucketFirst[Size + 1] = {};
+  usize byBucket[Size] = {};
+  usize maxLen = 0;
+  for(usize k = 0; k < Size; k++)
+  {
+    const Hashes hashes = hash(input[k].key);
+    lanes[k] = hashes.h[1];
+    bucketOf[k] = bucketIndex(hashes.h[0], Size);
+    maxLen = std::max(maxLen, ++bucketLen[bucketOf[k]]);
+  }
+  for(usize b = 0; b < Size; b++)
+  {
+    bucketFirst[b + 1] = bucketFirst[b] + bucketLen[b];
+  }
+  usize cursor[Size] = {};
+  for(usize k = 0; k < Size; k++)
+  {
+    const usize b = bucketOf[k];
+    byBucket[bucketFirst[b] + cursor[b]++] = k;
+  }
+
+  // place the buckets, largest first
+  bool taken[Size] = {};
+  usize slot[Size] = {};
+  for(usize bucketSize = maxLen; bucketSize > 0; bucketSize--)
+  {
+    for(usize b = 0; b < Size; b++)
+    {
+      if(bucketLen[b] != bucketSize)
+      {
+        continue;
+      }
+      bool placed = false;
+      for(u32 pilot = 0; !placed; pilot++)
+      {
+        assert(pilot < maxPilot_);
+        const u64 mixed = mix64(pilot + 0x9e3779b97f4a7c15ULL);
+        placed = true;
+        for(usize i = 0; i < bucketSize && placed; i++)
+        {
+          slot[i] = bucketIndex(lanes[byBucket[bucketFirst[b] + i]] ^ mixed, Size);
+          placed = !taken[slot[i]];
+          for(usize j = 0; j < i && placed; j++)
+          {
+            placed = (slot[j] != slot[i]);
+          }
+        }
+        if(placed)
+        {
+          this->pilots_[b] = mixed;
+          for(usize i = 0; i < bucketSize; i++)
+          {
+            taken[slot[i]] = true;
+            this->table_[slot[i]] = input[byBucket[bucketFirst[b] + i]];
+          }
+        }
+      }
+    }
+  }
+}
+
+// PerfectHashMap acessor functions
+// ----------------------------------------------------------------------------
+
+// length of the container
+// @param   container
+// @return  size
+template < typename KeyType, typename EntryType, usize Size >
+constexpr usize len(const PerfectHashMap< KeyType, EntryType, Size >&)
+{
+  return Size;
+}
+
+// number of elements the container can hold
+// @param   container
+// @return  capacity
+template < typename KeyType, typename EntryType, usize Size >
+constexpr usize capacity(const PerfectHashMap< KeyType, EntryType, Size >&)
+{
+  return Size;
+}
+
+// random accessor
+// @param container container to access
+// @param key       key of element to access
+// return pointer to the element entry or nullptr if key is not in the container
+template < typename KeyType, typename EntryType, usize Size >
+constexpr const EntryType* find(const PerfectHashMap< KeyType, EntryType, Size >& container,
+                                const KeyType& key)
+{
+  const Hashes hashes = hash(key);
+  const u64 pilot = container.pilots_[bucketIndex(hashes.h[0], Size)];
+  const usize pos = bucketIndex(hashes.h[1] ^ pilot, Size);
+  return (container.table_[pos].key == key) ? &(container.table_[pos].value) : nullptr;
+}
+
+// count number of elements that have key
+// @param container container to access
+// @param key       key of element to access
+// return number of elements with key (keys are unique: 0 or 1)
+template < typename KeyType, typename EntryType, usize Size >
+constexpr usize count(const PerfectHashMap< KeyType, EntryType, Size >& container,
+                      const KeyType& key)
+{
+  return find(container, key) ? 1 : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HashMap : swiss engine
+///////////////////////////////////////////////////////////////////////////////
+
+// group probed open addressing hash map:
+// every slot has a control byte, kept in a parallel array, that is either
+// free, deleted (tombstone) or the 7 bit H2 fingerprint of the key in it.
+// the slots are split in groups, a key is looked for starting at the group
+// picked by H1 and then along a triangular sequence of groups, comparing the
+// control bytes of a whole group at once, until the key or a group with a
+// free slot is found. H1 and H2 are taken from different Hashes lanes.
+// removals leave tombstones (unless the group has a free slot, then no probe
+// sequence goes past it), they are dropped by an in place rehash.
+template < typename KeyType, typename EntryType >
+struct HashMapInterface< KeyType, EntryType, SwissEngine >
+{
+  struct ElementType
+  {
+    KeyType key;
+    EntryType value;
+  };
+
+  // slots per group
+  GLOBAL const usize groupSlots_{8};
+  // table load (in eighths) that makes the container grow or drop tombstones
+  GLOBAL const usize maxLoad_{7};
+  // control bytes of the slots that hold no element
+  GLOBAL const u8 freeSlot_{0x00};
+  GLOBAL const u8 deletedSlot_{0x80};
+
+  // replace the table by a larger one holding the same elements
+  // return true -> grown | false -> container can not grow
+  virtual bool growTable() = 0;
+
+  ElementType init_;
+  usize length_;
+  usize deleted_; // number of tombstones
+  usize groups_;  // power of 2
+  ElementType* table_;
+  u8* ctrl_;
+
+  virtual ~HashMapInterface() {}
+  HashMapInterface() = delete;
+  explicit HashMapInterface(const ElementType& init);
+  explicit HashMapInterface(const HashMapInterface& other);
+  // TODO: Move constructor???
+};
+
+// GLOBAL
+template < typename KeyType, typename EntryType >
+const usize HashMapInterface< KeyType, EntryType, SwissEngine >::groupSlots_;
+template < typename KeyType, typename EntryType >
+const usize HashMapInterface< KeyType, EntryType, SwissEngine >::maxLoad_;
+template < typename KeyType, typename EntryType >
+const u8 HashMapInterface< KeyType, EntryType, SwissEngine >::freeSlot_;
+template < typename KeyType, typename EntryType >
+const u8 HashMapInterface< KeyType, EntryType, SwissEngine >::deletedSlot_;
+
+// default constructor
+template < typename KeyType, typename EntryType >
+HashMapInterface< KeyType, EntryType, SwissEngine >::HashMapInterface(
+    const typename HashMapInterface< KeyType, EntryType, SwissEngine >::ElementType& init)
+    : init_(init)
+    , length_(0)
+    , deleted_(0)
+    , groups_(0)
+    , table_(nullptr)
+    , ctrl_(nullptr)
+{
+}
+
+// copy constructor
+template < typename KeyType, typename EntryType >
+HashMapInterface< KeyType, EntryType, SwissEngine >::HashMapInterface(
+    const HashMapInterface< KeyType, EntryType, SwissEngine >& other)
+    : init_(other.init_)
+    , length_(other.length_)
+    , deleted_(other.deleted_)
+    , groups_(0)
+    , table_(nullptr)
+    , ctrl_(nullptr)
+{
+}
+
+// smallest (power of 2) number of groups that hold capacity elements under the max load
+// @param capacity   number of elements
+// @param groupSlots slots per group
+// @param maxLoad    max load in eighths
+// @return number of groups
+constexpr usize swissGroupCount(const usize capacity, const usize groupSlots, const usize maxLoad)
+{
+  usize groups = 1;
+  while(groups * groupSlots * maxLoad < capacity * 8)
+  {
+    groups *= 2;
+  }
+  return groups;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// FixedHashMap : fixed size hash map containter (swiss engine)
+///////////////////////////////////////////////////////////////////////////////
+
+template < typename KeyType, typename EntryType, usize Capacity >
+struct FixedHashMap< KeyType, EntryType, Capacity, SwissEngine >
+    : public HashMapInterface< KeyType, EntryType, SwissEngine >
+{
+  using ElementType = typename HashMapInterface< KeyType, EntryType, SwissEngine >::ElementType;
+  GLOBAL const usize groupCount_{
+      swissGroupCount(Capacity,
+                      HashMapInterface< KeyType, EntryType, SwissEngine >::groupSlots_,
+                      HashMapInterface< KeyType, EntryType, SwissEngine >::maxLoad_)};
+
+  FixedArray< ElementType,
+              groupCount_ * HashMapInterface< KeyType, EntryType, SwissEngine >::groupSlots_ >
+      data_;
+  u8 ctrlBuffer_[groupCount_ * HashMapInterface< KeyType, EntryType, SwissEngine >::groupSlots_];
+
+  virtual bool growTable() override { return false; };
+
+  virtual ~FixedHashMap() {}
+  FixedHashMap() = delete;
+  explicit FixedHashMap(const ElementType& init);
+  explicit FixedHashMap(const FixedHashMap& other);
+  FixedHashMap& operator=(const FixedHashMap& other);
+  // TODO: Move constructor???
+};
+
+// GLOBAL
+template < typename KeyType, typename EntryType, usize Capacity >
+const usize FixedHashMap< KeyType, EntryType, Capacity, SwissEngine >::groupCount_;
+
+// constructor
+template < typename KeyType, typename EntryType, usize Capacity >
+FixedHashMap< KeyType, EntryType, Capacity, SwissEngine >::FixedHashMap(
+    const typename FixedHashMap< KeyType, EntryType, Capacity, SwissEngine >::ElementType& init)
+    : HashMapInterface< KeyType, EntryType, SwissEngine >(init)
+    , data_(init)
+    , ctrlBuffer_{}
+{
+  this->groups_ = groupCount_;
+  this->table_ = this->data_.array_;
+  this->ctrl_ = this->ctrlBuffer_;
+}
+
+// copy constructor
+template < typename KeyType, typename EntryType, usize Capacity >
+FixedHashMap< KeyType, EntryType, Capacity, SwissEngine >::FixedHashMap(
+    const FixedHashMap< KeyType, EntryType, Capacity, SwissEngine >& other)
+    : HashMapInterface< KeyType, EntryType, SwissEngine >(other)
+    , data_(other.init_)
+    , ctrlBuffer_{}
+{
+  this->groups_ = groupCount_;
+  this->table_ = this->data_.array_;
+  this->ctrl_ = this->ctrlBuffer_;
+  std::copy(other.table_, (other.table_ + this->data_.capacity_), this->table_);
+  std::copy(other.ctrl_, (other.ctrl_ + this->data_.capacity_), this->ctrl_);
+}
+
+// assignement operator
+template < typename KeyType, typename EntryType, usize Capacity >
+FixedHashMap< KeyType, EntryType, Capacity, SwissEngine >&
+FixedHashMap< KeyType, EntryType, Capacity, SwissEngine >::
+operator=(const FixedHashMap< KeyType, EntryType, Capacity, SwissEngine >& other)
+{
+  this->init_ = other.init_;
+  std::copy(other.table_, (other.table_ + this->data_.capacity_), this->table_);
+  std::copy(other.ctrl_, (other.ctrl_ + this->data_.capacity_), this->ctrl_);
+  this->length_ = other.length_;
+  this->deleted_ = other.deleted_;
+
+  return *this;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HashMap : dynamic hash map containter (swiss engine)
+///////////////////////////////////////////////////////////////////////////////
+
+template < typename KeyType, typename EntryType, typename Allocator >
+struct HashMap< KeyType, EntryType, Allocator, SwissEngine >
+    : public HashMapInterface< KeyType, EntryType, SwissEngine >
+{
+  using ElementType = typename HashMapInterface< KeyType, EntryType, SwissEngine >::ElementType;
+  using AllocatorType = Allocator;
+
+  Allocator& alloc_;
+  Blk memBlock_;
+  Blk ctrlBlock_;
+
+  virtual bool growTable() override;
+
+  HashMap() = delete;
+  HashMap(Allocator& alloc, const ElementType& init, const usize Capacity);
+  explicit HashMap(const HashMap& other);
+  HashMap& operator=(const HashMap& other);
+  // TODO: Move constructor???
+  virtual ~HashMap();
+};
+
+// virtual destructor
+template < typename KeyType, typename EntryType, typename Allocator >
+HashMap< KeyType, EntryType, Allocator, SwissEngine >::~HashMap()
+{
+  if(this->memBlock_.ptr)
+  {
+    destroyElements(this->table_, this->groups_ * this->groupSlots_);
+    this->alloc_.deallocate(this->memBlock_);
+  }
+  if(this->ctrlBlock_.ptr)
+  {
+    this->alloc_.deallocate(this->ctrlBlock_);
+  }
+}
+
+// constructor
+template < typename KeyType, typename EntryType, typename Allocator >
+HashMap< KeyType, EntryType, Allocator, SwissEngine >::HashMap(
+    Allocator& alloc,
+    const typename HashMap< KeyType, EntryType, Allocator, SwissEngine >::ElementType& init,
+    const usize Capacity)
+    : HashMapInterface< KeyType, EntryType, SwissEngine >(init)
+    , alloc_{alloc}
+    , memBlock_{nullptr, 0}
+    , ctrlBlock_{nullptr, 0}
+{
+  const usize slots = this->groupSlots_;
+  this->groups_ = swissGroupCount(Capacity, slots, this->maxLoad_);
+  this->table_ = allocateType< ElementType, Allocator >(
+      this->alloc_, this->memBlock_, this->groups_ * slots);
+  this->ctrl_ =
+      allocateType< u8, Allocator >(this->alloc_, this->ctrlBlock_, this->groups_ * slots);
+  std::uninitialized_fill(this->table_, (this->table_ + this->groups_ * slots), this->init_);
+  std::fill(this->ctrl_, (this->ctrl_ + this->groups_ * slots), this->freeSlot_);
+}
+
+// copy constructor
+template < typename KeyType, typename EntryType, typename Allocator >
+HashMap< KeyType, EntryType, Allocator, SwissEngine >::HashMap(
+    const HashMap< KeyType, EntryType, Allocator, SwissEngine >& other)
+    : HashMapInterface< KeyType, EntryType, SwissEngine >(other)
+    , alloc_{other.alloc_}
+    , memBlock_{nullptr, 0}
+    , ctrlBlock_{nullptr, 0}
+{
+  const usize slots = this->groupSlots_;
+  this->groups_ = other.groups_;
+  this->table_ = allocateType< ElementType, Allocator >(
+      this->alloc_, this->memBlock_, this->groups_ * slots);
+  this->ctrl_ =
+      allocateType< u8, Allocator >(this->alloc_, this->ctrlBlock_, this->groups_ * slots);
+  std::uninitialized_copy(other.table_, (other.table_ + this->groups_ * slots), this->table_);
+  std::copy(other.ctrl_, (other.ctrl_ + this->groups_ * slots), this->ctrl_);
+}
+
+// assignement operator
+template < typename KeyType, typename EntryType, typename Allocator >
+HashMap< KeyType, EntryType, Allocator, SwissEngine >&
+HashMap< KeyType, EntryType, Allocator, SwissEngine >::
+operator=(const HashMap< KeyType, EntryType, Allocator, SwissEngine >& other)
+{
+  if(this->memBlock_.ptr)
+  {
+    destroyElements(this->table_, this->groups_ * this->groupSlots_);
+    this->alloc_.deallocate(this->memBlock_);
+    this->memBlock_ = {nullptr, 0};
+  }
+  if(this->ctrlBlock_.ptr)
+  {
+    this->alloc_.deallocate(this->ctrlBlock_);
+    this->ctrlBlock_ = {nullptr, 0};
+  }
+
+  const usize slots = this->groupSlots_;
+  this->init_ = other.init_;
+  this->groups_ = other.groups_;
+  this->table_ = allocateType< ElementType, Allocator >(
+      this->alloc_, this->memBlock_, this->groups_ * slots);
+  this->ctrl_ =
+      allocateType< u8, Allocator >(this->alloc_, this->ctrlBlock_, this->groups_ * slots);
+  std::uninitialized_copy(other.table_, (other.table_ + this->groups_ * slots), this->table_);
+  std::copy(other.ctrl_, (other.ctrl_ + this->groups_ * slots), this->ctrl_);
+  this->length_ = other.length_;
+  this->deleted_ = other.deleted_;
+
+  return *this;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Swiss helpers
+///////////////////////////////////////////////////////////////////////////////
+
+// 7 bit fingerprint of a key (H2)
+// NOTE: taken from the top bits of lane 0, while the probe start (H1) comes
+// from lane 1, 0 is reserved to mark free slots
+// @param hashes hashes of the key
+// @return control byte of the key
+inline u8 swissTag(const Hashes& hashes)
+{
+  const u8 tag = static_cast< u8 >(hashes.h[0] >> 57);
+  return tag ? tag : 0x01;
+}
+
+// search the probe sequence for the element holding key
+// @param container container to access
+// @param key       key of element to access (or a probe that compares with it)
+// @param hashes    hashes of the key
+// return pointer to the element or nullptr if key is not in the container
+template < typename KeyType, typename EntryType, typename ProbeType >
+inline typename HashMapInterface< KeyType, EntryType, SwissEngine >::ElementType* findElement(
+    HashMapInterface< KeyType, EntryType, SwissEngine >& container,
+    const ProbeType& key,
+    const Hashes& hashes)
+{
+  using ElementType = typename HashMapInterface< KeyType, EntryType, SwissEngine >::ElementType;
+  const usize slots = HashMapInterface< KeyType, EntryType, SwissEngine >::groupSlots_;
+  const u8 tag = swissTag(hashes);
+  const usize mask = container.groups_ - 1;
+
+  usize group = hashes.h[1] & mask;
+  for(usize step = 0; step < container.groups_; step++)
+  {
+    const u8* ctrl = container.ctrl_ + group * slots;
+    for(u32 match = matchTags< slots >(ctrl, tag); match; match &= match - 1)
+    {
+      ElementType* el = container.table_ + group * slots + countTrailingZeros(match);
+      if(el->key == key)
+      {
+        return el;
+      }
+    }
+    if(matchTags< slots >(ctrl, container.freeSlot_))
+    {
+      return nullptr;
+    }
+    group = (group + step + 1) & mask;
+  }
+  return nullptr;
+}
+
+// first free or deleted slot of the probe sequence of a key
+// @param container container to access
+// @param hashes    hashes of the key
+// return slot index | number of slots -> table is completely full
+template < typename KeyType, typename EntryType >
+usize findInsertSlot(HashMapInterface< KeyType, EntryType, SwissEngine >& container,
+                     const Hashes& hashes)
+{
+  const usize slots = HashMapInterface< KeyType, EntryType, SwissEngine >::groupSlots_;
+  const usize mask = container.groups_ - 1;
+
+  usize group = hashes.h[1] & mask;
+  for(usize step = 0; step < container.groups_; step++)
+  {
+    const u8* ctrl = container.ctrl_ + group * slots;
+    const u32 room = matchTags< slots >(ctrl, container.freeSlot_) |
+                     matchTags< slots >(ctrl, container.deletedSlot_);
+    if(room)
+    {
+      return group * slots + countTrailingZeros(room);
+    }
+    group = (group + step + 1) & mask;
+  }
+  return container.groups_ * slots;
+}
+
+// drop the tombstones, rehashing the elements inside the same table
+// NOTE: the elements are first all marked deleted (and the tombstones free),
+// then each one goes to the first free or deleted slot of its probe sequence:
+// kept when that is in its own group, moved when it is free or swapped with
+// the (still to rehash) element in it otherwise.
+// @param container container to access
+template < typename KeyType, typename EntryType >
+void rehashInPlace(HashMapInterface< KeyType, EntryType, SwissEngine >& container)
+{
+  const usize slots = HashMapInterface< KeyType, EntryType, SwissEngine >::groupSlots_;
+  const usize total = container.groups_ * slots;
+
+  for(usize i = 0; i < total; i++)
+  {
+    const bool full = (container.ctrl_[i] != container.freeSlot_) &&
+                      (container.ctrl_[i] != container.deletedSlot_);
+    container.ctrl_[i] = full ? container.deletedSlot_ : container.freeSlot_;
+  }
+
+  usize i = 0;
+  while(i < total)
+  {
+    if(container.ctrl_[i] == container.deletedSlot_)
+    {
+      const Hashes hashes = hash(container.table_[i].key);
+      const usize pos = findInsertSlot(container, hashes);
+      if(pos / slots == i / slots)
+      {
+        container.ctrl_[i] = swissTag(hashes);
+      }
+      else if(container.ctrl_[pos] == container.freeSlot_)
+      {
+        container.table_[pos] = container.table_[i];
+        container.ctrl_[pos] = swissTag(hashes);
+        container.table_[i] = container.init_;
+        container.ctrl_[i] = container.freeSlot_;
+      }
+      else
+      {
+        // the element swapped in still has to be rehashed
+        std::swap(container.table_[pos], container.table_[i]);
+        container.ctrl_[pos] = swissTag(hashes);
+        continue;
+      }
+    }
+    ++i;
+  }
+  container.deleted_ = 0;
+}
+
+// double the number of groups, rehashing every element into the new table
+// return true -> grown | false -> out of memory
+template < typename KeyType, typename EntryType, typename Allocator >
+bool HashMap< KeyType, EntryType, Allocator, SwissEngine >::growTable()
+{
+  const usize slots = this->groupSlots_;
+  const usize total = this->groups_ * slots;
+  Blk memBlock = {nullptr, 0};
+  Blk ctrlBlock = {nullptr, 0};
+  ElementType* table =
+      allocateType< ElementType, Allocator >(this->alloc_, memBlock, total * 2);
+  u8* ctrl = allocateType< u8, Allocator >(this->alloc_, ctrlBlock, total * 2);
+  if(!table || !ctrl)
+  {
+    if(memBlock.ptr)
+    {
+      this->alloc_.deallocate(memBlock);
+    }
+    if(ctrlBlock.ptr)
+    {
+      this->alloc_.deallocate(ctrlBlock);
+    }
+    return false;
+  }
+  std::uninitialized_fill(table, (table + total * 2), this->init_);
+  std::fill(ctrl, (ctrl + total * 2), this->freeSlot_);
+
+  ElementType* oldTable = this->table_;
+  const u8* oldCtrl = this->ctrl_;
+  const Blk oldMemBlock = this->memBlock_;
+  const Blk oldCtrlBlock = this->ctrlBlock_;
+  this->table_ = table;
+  this->ctrl_ = ctrl;
+  this->memBlock_ = memBlock;
+  this->ctrlBlock_ = ctrlBlock;
+  this->groups_ *= 2;
+  this->deleted_ = 0;
+
+  for(usize i = 0; i < total; i++)
+  {
+    if(oldCtrl[i] != this->freeSlot_ && oldCtrl[i] != this->deletedSlot_)
+    {
+      const usize pos = findInsertSlot(*this, hash(oldTable[i].key));
+      this->table_[pos] = oldTable[i];
+      this->ctrl_[pos] = oldCtrl[i];
+    }
+  }
+
+  destroyElements(oldTable, total);
+  this->alloc_.deallocate(oldMemBlock);
+  this->alloc_.deallocate(oldCtrlBlock);
+  return true;
+}
+
+// add an element whose key hashes are already known
+// @param container container to access
+// @param key       key of element to access
+// @param entry     element content
+// @param hashes    hashes of the key
+// return true -> inserted | false -> container is full
+template < typename KeyType, typename EntryType >
+bool emplaceElement(HashMapInterface< KeyType, EntryType, SwissEngine >& container,
+                    const KeyType& key,
+                    const EntryType& entry,
+                    const Hashes& hashes)
+{
+  typename HashMapInterface< KeyType, EntryType, SwissEngine >::ElementType* old =
+      findElement(container, key, hashes);
+  if(old)
+  {
+    old->value = entry;
+    return true;
+  }
+
+  const usize total = container.groups_ * container.groupSlots_;
+  usize pos = findInsertSlot(container, hashes);
+  const bool overLoad = (container.length_ + container.deleted_) * 8 >= total * container.maxLoad_;
+  if(pos == total || (container.ctrl_[pos] == container.freeSlot_ && overLoad))
+  {
+    // lots of tombstones: drop them, otherwise grow (a fixed container
+    // keeps filling its free slots past the max load)
+    if(container.deleted_ * 16 > total)
+    {
+      rehashInPlace(container);
+    }
+    else
+    {
+      container.growTable();
+    }
+    pos = findInsertSlot(container, hashes);
+    if(pos == container.groups_ * container.groupSlots_)
+    {
+      return false;
+    }
+  }
+
+  if(container.ctrl_[pos] == container.deletedSlot_)
+  {
+    --container.deleted_;
+  }
+  container.table_[pos] = {key, entry};
+  container.ctrl_[pos] = swissTag(hashes);
+  ++container.length_;
+  return true;
+}
+
+// prefetch the first group (control bytes and slots) of the probe sequence of a key
+// @param container container to access
+// @param hashes    hashes of the key
+template < typename KeyType, typename EntryType >
+inline void prefetchBuckets(HashMapInterface< KeyType, EntryType, SwissEngine >& container,
+                            const Hashes& hashes)
+{
+  const usize slots = HashMapInterface< KeyType, EntryType, SwissEngine >::groupSlots_;
+  const usize first = (hashes.h[1] & (container.groups_ - 1)) * slots;
+  prefetch(container.ctrl_ + first);
+  prefetch(container.table_ + first);
+  prefetch(reinterpret_cast< const u8* >(container.table_ + first + slots) - 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Swiss accessors
+///////////////////////////////////////////////////////////////////////////////
+
+// HashMap (swiss engine) acessor functions
+// ----------------------------------------------------------------------------
+
+// length of the container
+// @param   container
+// @return  size
+template < typename KeyType, typename EntryType >
+inline usize len(HashMapInterface< KeyType, EntryType, SwissEngine >& container)
+{
+  return container.length_;
+}
+
+// number of slots of the container
+// NOTE: FixedHashMap fills every slot, HashMap grows at the max load
+// @param   container
+// @return  capacity
+template < typename KeyType, typename EntryType >
+inline usize capacity(HashMapInterface< KeyType, EntryType, SwissEngine >& container)
+{
+  return container.groups_ * container.groupSlots_;
+}
+
+// clear the container
+// @param container
+template < typename KeyType, typename EntryType >
+inline void clear(HashMapInterface< KeyType, EntryType, SwissEngine >& container)
+{
+  std::fill(container.table_,
+            (container.table_ + container.groups_ * container.groupSlots_),
+            container.init_);
+  std::fill(container.ctrl_,
+            (container.ctrl_ + container.groups_ * container.groupSlots_),
+            container.freeSlot_);
+  container.length_ = 0;
+  container.deleted_ = 0;
+}
+
+// count number of elements that have key
+// @param container container to access
+// @param key       key of element to access
+// return number of elements with key (keys are unique: 0 or 1)
+template < typename KeyType, typename EntryType, typename ProbeType >
+inline usize count(HashMapInterface< KeyType, EntryType, SwissEngine >& container, const ProbeType& key)
+{
+  if(container.length_)
+  {
+    return findElement(container, key, hashAs< KeyType >(key)) ? 1 : 0;
+  }
+  return 0;
+}
+
+// random accessor
+// NOTE: key may be a probe of another type, as with the cuckoo engine
+// @param container container to access
+// @param key       key of element to access
+// return pointer to the element at the container required position
+template < typename KeyType, typename EntryType, typename ProbeType >
+inline EntryType* find(HashMapInterface< KeyType, EntryType, SwissEngine >& container, const ProbeType& key)
+{
+  if(container.length_)
+  {
+    typename HashMapInterface< KeyType, EntryType, SwissEngine >::ElementType* el =
+        findElement(container, key, hashAs< KeyType >(key));
+    if(el)
+    {
+      return &(el->value);
+    }
+  }
+  return nullptr;
+}
+
+// add a new element to the key (overwrites the entry if key is present)
+// @param container container to access
+// @param key       key of element to access
+// @param entry     element content
+// return true -> inserted | false -> container is full
+template < typename KeyType, typename EntryType >
+inline bool emplace(HashMapInterface< KeyType, EntryType, SwissEngine >& container,
+                    const KeyType& key,
+                    const EntryType& entry)
+{
+  return emplaceElement(container, key, entry, hash(key));
+}
+
+// remove an element from container
+// NOTE: key may be a probe of another type, as with find
+// @param container container to access
+// @param key       key of element to remove
+// return true -> removed | false -> key not found
+template < typename KeyType, typename EntryType, typename ProbeType >
+inline bool remove(HashMapInterface< KeyType, EntryType, SwissEngine >& container,
+                   const ProbeType& key)
+{
+  const usize slots = HashMapInterface< KeyType, EntryType, SwissEngine >::groupSlots_;
+  if(container.length_)
+  {
+    typename HashMapInterface< KeyType, EntryType, SwissEngine >::ElementType* el =
+        findElement(container, key, hashAs< KeyType >(key));
+    if(el)
+    {
+      const usize pos = el - container.table_;
+      *el = container.init_;
+      --container.length_;
+      // a group with a free slot never made a probe sequence go on
+      if(matchTags< slots >(container.ctrl_ + (pos / slots) * slots, container.freeSlot_))
+      {
+        container.ctrl_[pos] = container.freeSlot_;
+      }
+      else
+      {
+        container.ctrl_[pos] = container.deletedSlot_;
+        ++container.deleted_;
+      }
+      return true;
+    }
+  }
+  return false;
 }
 
 } // end namespace Montreal
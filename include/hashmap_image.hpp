@@ -0,0 +1,511 @@
+/**
+The MIT License (MIT)
+
+Copyright (c) 2016 Flavio Moreira
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef HASHMAP_IMAGE_HPP
+#define HASHMAP_IMAGE_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hashmap.hpp"
+#include "strings.hpp"
+
+namespace Montreal
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// HashMapImage : read only view of a hash map saved to a file
+///////////////////////////////////////////////////////////////////////////////
+
+// a (cuckoo engine) hash map is saved with its table layout unchanged, so a
+// mapped image is looked up in place: no rehashing and no copy of the table,
+// the pages are read from the page cache as lookups touch them.
+// the image is position independent (no pointers, only offsets from its
+// start) and laid out as:
+//   HashMapImageHeader | tags | table records | stash records | blob
+// keys and entries are saved through a HashMapImageCodec: trivially copyable
+// types are saved as they are, StringWrapper keeps its characters in the blob
+// and an offset and length in the record.
+// NOTE: images are not portable across byte orders or type layouts, the
+// header records what is needed to reject an image built differently.
+
+GLOBAL const char hashMapImageMagic[8] = {'M', 'T', 'L', 'H', 'M', 'A', 'P', '\0'};
+// bump whenever the image layout changes
+GLOBAL const u32 hashMapImageVersion = 1;
+// hash variant of the build, keys hash differently when any of it changes:
+// 0x1 -> three hash functions (MONTREAL_TRIPLE_HASH, see Hashes)
+// 0x2 -> no 128 bit multiply, mulFold falls back to mix64
+GLOBAL const u32 hashMapImageFlags =
+#if defined(MONTREAL_TRIPLE_HASH)
+    0x1 |
+#endif
+#if !defined(__SIZEOF_INT128__)
+    0x2 |
+#endif
+    0x0;
+
+struct HashMapImageHeader
+{
+  char magic_[8];
+  u32 version_;
+  u32 flags_;
+  u64 seed_; // seed the keys were hashed with
+  u64 length_;
+  u64 buckets_;
+  u64 bucketSlots_;
+  u64 stashLen_;
+  u32 keySize_;   // saved key and entry sizes, a coarse check that the
+  u32 entrySize_; // image is opened with the types it was saved with
+  u64 tagsOffset_;
+  u64 tableOffset_;
+  u64 stashOffset_;
+  u64 blobOffset_;
+  u64 size_; // whole image, in bytes
+};
+
+// characters of a string saved in the image blob
+struct HashMapImageString
+{
+  u64 offset_; // from the blob start
+  u64 length_;
+};
+
+// save and compare a key or entry type in an image
+// NOTE: only trivially copyable, non pointer types are saved as they are,
+// other types need a specialization
+template < typename Type, typename Enable = void >
+struct HashMapImageCodec;
+
+template < typename Type >
+struct HashMapImageCodec<
+    Type,
+    typename std::enable_if< std::is_trivially_copyable< Type >::value &&
+                             !std::is_pointer< Type >::value >::type >
+{
+  using StoredType = Type;
+
+  // bytes the value takes in the blob
+  static usize blobSize(const Type&) { return 0; }
+  // record field of the value
+  // @param blobOffset where writeBlob puts the value bytes in the blob
+  static StoredType store(const Type& value, const u64) { return value; }
+  // append the value bytes to the blob
+  static bool writeBlob(const Type&, std::FILE*) { return true; }
+  // compare a record field against a probe
+  // @param blob     image blob
+  // @param blobSize image blob size, in bytes
+  template < typename ProbeType >
+  static bool matches(const StoredType& stored, const ProbeType& probe, const char*, const u64)
+  {
+    return stored == probe;
+  }
+};
+
+template <>
+struct HashMapImageCodec< StringWrapper >
+{
+  using StoredType = HashMapImageString;
+
+  static usize blobSize(const StringWrapper& str) { return str.length(); }
+  static StoredType store(const StringWrapper& str, const u64 blobOffset)
+  {
+    return HashMapImageString{blobOffset, str.length()};
+  }
+  static bool writeBlob(const StringWrapper& str, std::FILE* file)
+  {
+    return std::fwrite(str.cStr(), 1, str.length(), file) == str.length();
+  }
+  // NOTE: the record comes from the file, a string that does not fit in the
+  // blob (truncated or corrupt image) matches nothing
+  template < typename ProbeType >
+  static bool matches(const StoredType& stored,
+                      const ProbeType& probe,
+                      const char* blob,
+                      const u64 blobSize)
+  {
+    return inBlob(stored, blobSize) && StaticString(blob + stored.offset_, stored.length_) == probe;
+  }
+  // view of the characters of a record field (empty if it is not in the blob)
+  static StaticString load(const StoredType& stored, const char* blob, const u64 blobSize)
+  {
+    return inBlob(stored, blobSize) ? StaticString(blob + stored.offset_, stored.length_)
+                                    : StaticString();
+  }
+  // check a record field against the blob bounds
+  static bool inBlob(const StoredType& stored, const u64 blobSize)
+  {
+    return stored.offset_ <= blobSize && stored.length_ <= blobSize - stored.offset_;
+  }
+};
+
+// read only view of a mapped image
+// NOTE: not copyable, the destructor unmaps the file
+template < typename KeyType, typename EntryType >
+struct HashMapImage
+{
+  using KeyCodec = HashMapImageCodec< KeyType >;
+  using EntryCodec = HashMapImageCodec< EntryType >;
+
+  struct RecordType
+  {
+    typename KeyCodec::StoredType key;
+    typename EntryCodec::StoredType value;
+  };
+
+  const char* base_;
+  usize size_;
+  const HashMapImageHeader* header_;
+  const u8* tags_;
+  const RecordType* table_;
+  const RecordType* stash_;
+  const u8* stashTags_;
+  const char* blob_;
+  u64 blobSize_;
+
+  ~HashMapImage();
+  HashMapImage();
+  HashMapImage(const HashMapImage&) = delete;
+  HashMapImage& operator=(const HashMapImage&) = delete;
+};
+
+template < typename KeyType, typename EntryType >
+HashMapImage< KeyType, EntryType >::~HashMapImage()
+{
+  closeImage(*this);
+}
+
+template < typename KeyType, typename EntryType >
+HashMapImage< KeyType, EntryType >::HashMapImage()
+    : base_(nullptr)
+    , size_(0)
+    , header_(nullptr)
+    , tags_(nullptr)
+    , table_(nullptr)
+    , stash_(nullptr)
+    , stashTags_(nullptr)
+    , blob_(nullptr)
+    , blobSize_(0)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HashMapImage functions
+///////////////////////////////////////////////////////////////////////////////
+
+// round an image offset up to the alignment of a section
+// @param offset    offset to round
+// @param alignment section alignment (a power of 2)
+// @return aligned offset
+constexpr u64 imageAlign(const u64 offset, const u64 alignment)
+{
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// write zero bytes up to an offset
+// @param file   file to write
+// @param from   current offset
+// @param to     offset to reach (at most 64 bytes ahead)
+// return true -> written | false -> write error
+inline bool writeImagePadding(std::FILE* file, const u64 from, const u64 to)
+{
+  const char zeros[64] = {};
+  return std::fwrite(zeros, 1, to - from, file) == to - from;
+}
+
+// save a container as an image
+// NOTE: an incremental rehash in progress is finished first, so the image
+// has a single table. the file is written to path (replacing it)
+// @param container container to save
+// @param path      file to write
+// return true -> saved | false -> rehash stuck or write error
+template < typename KeyType, typename EntryType >
+bool saveImage(HashMapInterface< KeyType, EntryType >& container, const char* path)
+{
+  using Image = HashMapImage< KeyType, EntryType >;
+  using RecordType = typename Image::RecordType;
+  using KeyCodec = typename Image::KeyCodec;
+  using EntryCodec = typename Image::EntryCodec;
+  using ElementType = typename HashMapInterface< KeyType, EntryType >::ElementType;
+  const usize slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+
+  while(container.oldTable_ && migrateBuckets(container))
+  {
+  }
+  if(container.oldTable_)
+  {
+    return false;
+  }
+
+  const u64 tableSlots = container.buckets_ * slots;
+  HashMapImageHeader header = {};
+  std::memcpy(header.magic_, hashMapImageMagic, sizeof(header.magic_));
+  header.version_ = hashMapImageVersion;
+  header.flags_ = hashMapImageFlags;
+  header.seed_ = defaultHashSeed;
+  header.length_ = container.length_;
+  header.buckets_ = container.buckets_;
+  header.bucketSlots_ = slots;
+  header.stashLen_ = container.stashLen_;
+  header.keySize_ = sizeof(typename KeyCodec::StoredType);
+  header.entrySize_ = sizeof(typename EntryCodec::StoredType);
+  header.tagsOffset_ = sizeof(HashMapImageHeader);
+  // records start on a cache line
+  header.tableOffset_ = imageAlign(header.tagsOffset_ + tableSlots + container.stashSize_, 64);
+  header.stashOffset_ = header.tableOffset_ + tableSlots * sizeof(RecordType);
+  header.blobOffset_ = header.stashOffset_ + container.stashSize_ * sizeof(RecordType);
+
+  // one record per slot, free slots are written as zeros
+  u64 blobLen = 0;
+  auto record = [&blobLen](const ElementType& el, RecordType& rec) {
+    rec.key = KeyCodec::store(el.key, blobLen);
+    blobLen += KeyCodec::blobSize(el.key);
+    rec.value = EntryCodec::store(el.value, blobLen);
+    blobLen += EntryCodec::blobSize(el.value);
+  };
+  auto blob = [](const ElementType& el, std::FILE* file) {
+    return KeyCodec::writeBlob(el.key, file) && EntryCodec::writeBlob(el.value, file);
+  };
+
+  std::FILE* file = std::fopen(path, "wb");
+  if(!file)
+  {
+    return false;
+  }
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(container.tags_, 1, tableSlots, file) == tableSlots &&
+            std::fwrite(container.stashTags_, 1, container.stashSize_, file) ==
+                container.stashSize_ &&
+            writeImagePadding(
+                file, header.tagsOffset_ + tableSlots + container.stashSize_, header.tableOffset_);
+
+  for(u64 s = 0; ok && s < tableSlots + container.stashSize_; s++)
+  {
+    RecordType rec;
+    std::memset(&rec, 0, sizeof(rec));
+    if(s < tableSlots ? container.tags_[s] != 0 : (s - tableSlots) < container.stashLen_)
+    {
+      record(s < tableSlots ? container.table_[s] : container.stash_[s - tableSlots], rec);
+    }
+    ok = std::fwrite(&rec, sizeof(rec), 1, file) == 1;
+  }
+
+  // blob, in the same order the records took their offsets
+  for(u64 s = 0; ok && s < tableSlots; s++)
+  {
+    ok = !container.tags_[s] || blob(container.table_[s], file);
+  }
+  for(usize s = 0; ok && s < container.stashLen_; s++)
+  {
+    ok = blob(container.stash_[s], file);
+  }
+
+  // the size is only known now
+  header.size_ = header.blobOffset_ + blobLen;
+  ok = ok && std::fseek(file, 0, SEEK_SET) == 0 &&
+       std::fwrite(&header, sizeof(header), 1, file) == 1;
+  return (std::fclose(file) == 0) && ok;
+}
+
+// unmap an image (no lookup may be running)
+// @param image view to close
+template < typename KeyType, typename EntryType >
+void closeImage(HashMapImage< KeyType, EntryType >& image)
+{
+  if(image.base_)
+  {
+    ::munmap(const_cast< char* >(image.base_), image.size_);
+  }
+  image.base_ = nullptr;
+  image.size_ = 0;
+  image.header_ = nullptr;
+  image.tags_ = nullptr;
+  image.table_ = nullptr;
+  image.stash_ = nullptr;
+  image.stashTags_ = nullptr;
+  image.blob_ = nullptr;
+  image.blobSize_ = 0;
+}
+
+// map an image file
+// NOTE: the image is checked against this build (version, hash mode, type
+// layouts and bounds), a view already open is closed first
+// @param image view to open
+// @param path  file to map
+// return true -> mapped | false -> missing file or image not usable
+template < typename KeyType, typename EntryType >
+bool openImage(HashMapImage< KeyType, EntryType >& image, const char* path)
+{
+  using Image = HashMapImage< KeyType, EntryType >;
+  using RecordType = typename Image::RecordType;
+
+  closeImage(image);
+  const int fd = ::open(path, O_RDONLY);
+  if(fd < 0)
+  {
+    return false;
+  }
+  struct stat info;
+  if(::fstat(fd, &info) != 0 || static_cast< usize >(info.st_size) < sizeof(HashMapImageHeader))
+  {
+    ::close(fd);
+    return false;
+  }
+  const usize size = static_cast< usize >(info.st_size);
+  void* base = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping stays valid once the descriptor is closed
+  ::close(fd);
+  if(base == MAP_FAILED)
+  {
+    return false;
+  }
+
+  // NOTE: every field comes from the file, the bounds are checked in an
+  // order where each offset is known to be within size before it is used,
+  // and sums and products are compared as differences and quotients of
+  // size (a crafted header may not wrap them around)
+  const HashMapImageHeader* header = static_cast< const HashMapImageHeader* >(base);
+  const u64 slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+  const u64 stashSize = HashMapInterface< KeyType, EntryType >::stashSize_;
+  const u64 recordSize = sizeof(RecordType);
+  const u64 tableSlots = header->buckets_ * slots; // checked below before used
+  if(std::memcmp(header->magic_, hashMapImageMagic, sizeof(header->magic_)) != 0 ||
+     header->version_ != hashMapImageVersion || header->flags_ != hashMapImageFlags ||
+     header->bucketSlots_ != slots ||
+     header->keySize_ != sizeof(typename Image::KeyCodec::StoredType) ||
+     header->entrySize_ != sizeof(typename Image::EntryCodec::StoredType) ||
+     header->size_ != size || header->stashLen_ > stashSize ||
+     header->buckets_ == 0 || header->buckets_ >= (u64(1) << 32) ||
+     header->buckets_ > (size / slots) ||
+     header->length_ > tableSlots + stashSize ||
+     header->tagsOffset_ != sizeof(HashMapImageHeader) ||
+     tableSlots + stashSize > size - header->tagsOffset_ ||
+     header->tableOffset_ < header->tagsOffset_ + tableSlots + stashSize ||
+     header->tableOffset_ > size || header->tableOffset_ % alignof(RecordType) != 0 ||
+     tableSlots > (size - header->tableOffset_) / recordSize ||
+     header->stashOffset_ != header->tableOffset_ + tableSlots * recordSize ||
+     stashSize > (size - header->stashOffset_) / recordSize ||
+     header->blobOffset_ != header->stashOffset_ + stashSize * recordSize)
+  {
+    ::munmap(base, size);
+    return false;
+  }
+
+  image.base_ = static_cast< const char* >(base);
+  image.size_ = size;
+  image.header_ = header;
+  image.tags_ = reinterpret_cast< const u8* >(image.base_ + header->tagsOffset_);
+  image.stashTags_ = image.tags_ + tableSlots;
+  image.table_ = reinterpret_cast< const RecordType* >(image.base_ + header->tableOffset_);
+  image.stash_ = reinterpret_cast< const RecordType* >(image.base_ + header->stashOffset_);
+  image.blob_ = image.base_ + header->blobOffset_;
+  image.blobSize_ = size - header->blobOffset_;
+  return true;
+}
+
+// search the candidate buckets and the stash of an image for a record
+// @param image view to access
+// @param key   key of element to access (or a probe that compares with it)
+// return pointer to the record or nullptr if key is not in the image
+template < typename KeyType, typename EntryType, typename ProbeType >
+inline const typename HashMapImage< KeyType, EntryType >::RecordType* findRecord(
+    const HashMapImage< KeyType, EntryType >& image, const ProbeType& key)
+{
+  using Image = HashMapImage< KeyType, EntryType >;
+  using RecordType = typename Image::RecordType;
+  const usize slots = HashMapInterface< KeyType, EntryType >::bucketSlots_;
+
+  const Hashes hashes = hashAs< KeyType >(key, image.header_->seed_);
+  const u8 tag = hashTag(hashes);
+  for(u8 i = 0; i < 3; i++)
+  {
+    const usize first = bucketIndex(hashes.h[i], image.header_->buckets_) * slots;
+    for(u32 match = matchTags< slots >(image.tags_ + first, tag); match; match &= match - 1)
+    {
+      const RecordType* rec = image.table_ + first + countTrailingZeros(match);
+      if(Image::KeyCodec::matches(rec->key, key, image.blob_, image.blobSize_))
+      {
+        return rec;
+      }
+    }
+  }
+  for(usize s = 0; s < image.header_->stashLen_; s++)
+  {
+    if(image.stashTags_[s] == tag &&
+       Image::KeyCodec::matches(image.stash_[s].key, key, image.blob_, image.blobSize_))
+    {
+      return (image.stash_ + s);
+    }
+  }
+  return nullptr;
+}
+
+// get the number of elements in an image
+// @param image view to access
+// return number of elements
+template < typename KeyType, typename EntryType >
+inline usize len(const HashMapImage< KeyType, EntryType >& image)
+{
+  return image.header_ ? image.header_->length_ : 0;
+}
+
+// count number of elements that have key
+// @param image view to access
+// @param key   key of element to access
+// return number of elements with key (keys are unique: 0 or 1)
+template < typename KeyType, typename EntryType, typename ProbeType >
+inline usize count(const HashMapImage< KeyType, EntryType >& image, const ProbeType& key)
+{
+  return (len(image) && findRecord(image, key)) ? 1 : 0;
+}
+
+// random accessor
+// NOTE: the entry is returned as saved by its codec (e.g. an entry of a
+// trivially copyable type is the entry itself), key may be a probe as in
+// HashMap find
+// @param image view to access
+// @param key   key of element to access
+// return pointer to the saved entry or nullptr if key is not in the image
+template < typename KeyType, typename EntryType, typename ProbeType >
+inline const typename HashMapImageCodec< EntryType >::StoredType*
+find(const HashMapImage< KeyType, EntryType >& image, const ProbeType& key)
+{
+  if(len(image))
+  {
+    const typename HashMapImage< KeyType, EntryType >::RecordType* rec = findRecord(image, key);
+    if(rec)
+    {
+      return &(rec->value);
+    }
+  }
+  return nullptr;
+}
+
+} // end namespace Montreal
+
+#endif // HASHMAP_IMAGE_HPP
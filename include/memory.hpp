@@ -39,6 +39,11 @@ SOFTWARE.
   using PrimaryAlloc = Selector< 8192, FLAllocator7, MAllocator< 1 > >;
   using CompAllocator = FallbackAllocator< PrimaryAlloc, MAllocator< 2 > >;
 
+  the same eight size classes without walking a chain of freelists:
+  using BankAllocator = SizeClassBank< StkAllocator, 262144,
+                                       64, 128, 256, 512, 1024, 2048, 4096, 8192 >;
+  using PrimaryAlloc = Selector< 8192, BankAllocator, MAllocator< 1 > >;
+
 
   FIXME: The use of free lists may lead to fragmentation.
   Needs a way to have shorter freelists and to recover part of the memory.
@@ -46,6 +51,8 @@ SOFTWARE.
   contiguous to some other and if so merge them and buble them up.
   Ideally all free space should be kept as the largest possible
   chunk sizes!
+  NOTE: CoalescingAllocator does that merging (boundary tags) and can stand
+  in for the StackAllocator when blocks are freed out of order.
 */
 
 #ifndef MEMORY_HPP
@@ -53,6 +60,15 @@ SOFTWARE.
 
 #include "functions.hpp"
 #include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
 
 namespace Montreal
 {
@@ -60,16 +76,24 @@ namespace Montreal
 // allocator based on ideas from Alexandrescu:
 // https://github.com/CppCon/CppCon2015/tree/master/Presentations/allocator%20Is%20to%20Allocation%20what%20vector%20Is%20to%20Vexation
 
-// FIXME: add reference count as a header of the memory chunk
-// NOTE: perhaps the size should be a header info as well
+// NOTE: HeaderAllocator keeps the size and a reference count in a header
+// in front of the memory chunk
 // memory block
 struct Blk
 {
   void* ptr;
   usize size;
-  // usize refCount;
 };
 
+// number of power of 2 size classes from minSize up to (at least) maxSize
+// @param minSize smallest class size (a power of 2)
+// @param maxSize largest block size served by the classes
+// @return number of classes
+constexpr usize sizeClassCount(const usize minSize, const usize maxSize)
+{
+  return (minSize >= maxSize) ? 1 : 1 + sizeClassCount(minSize << 1, maxSize);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Fallback: try primary alloc, if alloc fails try secondary
 ///////////////////////////////////////////////////////////////////////////////
@@ -174,6 +198,141 @@ bool Selector< threshold, SmallAllocator, LargeAllocator >::owns(Blk b)
   return SmallAllocator::owns(b) || LargeAllocator::owns(b);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// HeaderAllocator: prepends a header (size, ref count, owner) to each block
+///////////////////////////////////////////////////////////////////////////////
+
+// header in front of every block of a HeaderAllocator
+// NOTE: 32 bytes, so blocks keep the 16 byte alignment of the parent
+struct BlkHeader
+{
+  usize size;     // bytes requested (header not included)
+  usize refCount; // references to the block, it is freed when it drops to 0
+  u64 tag;        // owner tag of the allocator that made the block
+  u64 pad;
+};
+
+// the header makes blocks self describing: deallocate and release take just
+// the pointer, in constant time.
+// owns stays address based: the parent has to own the header address before
+// the owner tag is read (e.g. a block of the other side of a
+// FallbackAllocator is never read), the tag then catches stale blocks.
+// ownerTag must be unique among the HeaderAllocators of a composite.
+template < class Parent, u16 ownerTag >
+class HeaderAllocator : private Parent
+{
+public:
+  GLOBAL const usize headerSize_{sizeof(BlkHeader)};
+  GLOBAL const u64 tag_{0x4d544c424c4b0000ULL | ownerTag}; // "MTLBLK" + owner
+
+  HeaderAllocator()
+      : Parent()
+  {
+  }
+
+  Blk allocate(usize n);
+  void deallocate(Blk b);
+  void deallocate(void* ptr);
+  bool owns(Blk b);
+  void addRef(void* ptr);
+  bool release(void* ptr);
+
+private:
+  HeaderAllocator(HeaderAllocator& other) = delete;
+  HeaderAllocator& operator=(const HeaderAllocator& other) = delete;
+};
+
+// GLOBAL
+template < class Parent, u16 ownerTag >
+const usize HeaderAllocator< Parent, ownerTag >::headerSize_;
+template < class Parent, u16 ownerTag >
+const u64 HeaderAllocator< Parent, ownerTag >::tag_;
+
+// header of a block made by a HeaderAllocator
+// @param ptr pointer to the block
+// @return block header
+inline BlkHeader* blockHeader(void* ptr)
+{
+  return reinterpret_cast< BlkHeader* >(static_cast< char* >(ptr) - sizeof(BlkHeader));
+}
+
+// memory block described by the header of a block
+// @param ptr pointer to the block (made by a HeaderAllocator)
+// @return memory block
+inline Blk headerBlock(void* ptr) { return {ptr, blockHeader(ptr)->size}; }
+
+// allocate chunk of certain size into memory block
+// NOTE: the block starts with a single reference
+// @param n size of memory chunk
+// @return allocated memory block
+template < class Parent, u16 ownerTag >
+Blk HeaderAllocator< Parent, ownerTag >::allocate(usize n)
+{
+  Blk r = Parent::allocate(n + headerSize_);
+  if(!r.ptr)
+  {
+    return {nullptr, 0};
+  }
+  BlkHeader* header = static_cast< BlkHeader* >(r.ptr);
+  header->size = n;
+  header->refCount = 1;
+  header->tag = tag_;
+  header->pad = 0;
+  return {static_cast< void* >(header + 1), n};
+}
+
+// deallocate chunk described by block
+// @param b memory block
+template < class Parent, u16 ownerTag >
+void HeaderAllocator< Parent, ownerTag >::deallocate(Blk b)
+{
+  this->deallocate(b.ptr);
+}
+
+// deallocate chunk, whatever its reference count
+// @param ptr pointer to the block
+template < class Parent, u16 ownerTag >
+void HeaderAllocator< Parent, ownerTag >::deallocate(void* ptr)
+{
+  BlkHeader* header = blockHeader(ptr);
+  assert(header->tag == tag_);
+  // a stale pointer must not pass as owned
+  header->tag = 0;
+  Parent::deallocate({static_cast< void* >(header), header->size + headerSize_});
+}
+
+// check if the chunk is owned by this allocator
+// @param b memory block
+// @return true -> owns | false -> does not own
+template < class Parent, u16 ownerTag >
+bool HeaderAllocator< Parent, ownerTag >::owns(Blk b)
+{
+  return b.ptr && Parent::owns({static_cast< void* >(blockHeader(b.ptr)), b.size + headerSize_}) &&
+         blockHeader(b.ptr)->tag == tag_;
+}
+
+// add a reference to a block
+// @param ptr pointer to the block
+template < class Parent, u16 ownerTag >
+void HeaderAllocator< Parent, ownerTag >::addRef(void* ptr)
+{
+  ++(blockHeader(ptr)->refCount);
+}
+
+// drop a reference to a block, the last one deallocates it
+// @param ptr pointer to the block
+// @return true -> block deallocated | false -> block still referenced
+template < class Parent, u16 ownerTag >
+bool HeaderAllocator< Parent, ownerTag >::release(void* ptr)
+{
+  if(--(blockHeader(ptr)->refCount))
+  {
+    return false;
+  }
+  this->deallocate(ptr);
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Freelist: Keeps list of previous allocations of any given size
 ///////////////////////////////////////////////////////////////////////////////
@@ -248,237 +407,1628 @@ bool Freelist< Parent, minSize, maxSize, maxBlocks >::owns(Blk b)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// MAllocator: simple wraper around malloc to keep the interface consistent
+// SizeClassBank: one freelist per size class, reached in constant time
 ///////////////////////////////////////////////////////////////////////////////
 
-// if Mallocator is used more than once in an allocator composite, the id of each
-// component MAllocator has to be different to avoid ambiguity @ template resolution
-template < u8 id >
-class MAllocator
+// size class of every granule of block sizes
+template < usize entries >
+struct SizeClassTable
+{
+  u8 index_[entries];
+};
+
+// map block sizes, in granules, to the smallest class that holds them
+// @param sizes   class sizes (ascending)
+// @param granule step of the table in bytes
+// @return table, entry i is the class of sizes up to i * granule
+template < usize entries >
+constexpr SizeClassTable< entries > sizeClassTable(const usize* sizes, const usize granule)
+{
+  SizeClassTable< entries > table{};
+  usize c = 0;
+  for(usize e = 0; e < entries; e++)
+  {
+    while(sizes[c] < e * granule)
+    {
+      ++c;
+    }
+    table.index_[e] = static_cast< u8 >(c);
+  }
+  return table;
+}
+
+// check a class list: block sizes in ascending order, multiples of granule
+// @param sizes   class sizes
+// @param count   number of classes
+// @param granule step of the class table in bytes
+// @return true -> valid list | false -> invalid list
+constexpr bool validSizeClasses(const usize* sizes, const usize count, const usize granule)
+{
+  for(usize c = 0; c < count; c++)
+  {
+    if(!sizes[c] || sizes[c] % granule || (c && sizes[c - 1] >= sizes[c]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// the chain of Freelist layers of the composite example in one layer:
+// the class of a size comes from a table lookup and the class list is
+// accessed directly, so allocate and deallocate cost the same whatever the
+// number of classes. each class keeps up to budget bytes of blocks (like the
+// example, where maxBlocks halves as the size doubles).
+// classes are the block sizes, ascending multiples of 16.
+// NOTE: owns asks the parent about the block address (every block comes from
+// it), a block size says nothing: e.g. a Selector at maxSize sends blocks
+// of maxSize bytes to its other allocator.
+template < class Parent, usize budget, usize... classes >
+class SizeClassBank : private Parent
 {
 public:
-  MAllocator() {}
+  GLOBAL const usize granule_{16};
+  GLOBAL const usize count_{sizeof...(classes)};
+  GLOBAL constexpr usize sizes_[count_] = {classes...};
+  GLOBAL const usize maxSize_{sizes_[count_ - 1]};
+  GLOBAL const usize entries_{maxSize_ / granule_ + 1};
+  GLOBAL constexpr SizeClassTable< entries_ > table_ =
+      sizeClassTable< entries_ >(sizes_, granule_);
+
+  SizeClassBank();
+
   Blk allocate(usize n);
   void deallocate(Blk b);
   bool owns(Blk b);
 
 private:
-  MAllocator(MAllocator& other) = delete;
-  MAllocator& operator=(const MAllocator& other) = delete;
+  SizeClassBank(SizeClassBank& other) = delete;
+  SizeClassBank& operator=(SizeClassBank& other) = delete;
+  struct Node
+  {
+    Node* next;
+  };
+
+  Node* roots_[count_];
+  usize countDown_[count_];
 };
 
+// GLOBAL
+template < class Parent, usize budget, usize... classes >
+const usize SizeClassBank< Parent, budget, classes... >::granule_;
+template < class Parent, usize budget, usize... classes >
+const usize SizeClassBank< Parent, budget, classes... >::count_;
+template < class Parent, usize budget, usize... classes >
+constexpr usize SizeClassBank< Parent, budget, classes... >::sizes_[];
+template < class Parent, usize budget, usize... classes >
+const usize SizeClassBank< Parent, budget, classes... >::maxSize_;
+template < class Parent, usize budget, usize... classes >
+const usize SizeClassBank< Parent, budget, classes... >::entries_;
+template < class Parent, usize budget, usize... classes >
+constexpr SizeClassTable< SizeClassBank< Parent, budget, classes... >::entries_ >
+    SizeClassBank< Parent, budget, classes... >::table_;
+
+template < class Parent, usize budget, usize... classes >
+SizeClassBank< Parent, budget, classes... >::SizeClassBank()
+    : Parent()
+{
+  static_assert(sizeof...(classes) > 0 && sizeof...(classes) < 256, "1 to 255 classes");
+  static_assert(validSizeClasses(sizes_, count_, granule_),
+                "classes must be ascending multiples of 16");
+  for(usize c = 0; c < count_; c++)
+  {
+    this->roots_[c] = nullptr;
+    this->countDown_[c] = std::max(budget / sizes_[c], static_cast< usize >(1));
+  }
+}
+
 // allocate chunk of certain size into memory block
 // @param n size of memory chunk
 // @return allocated memory block
-template < u8 id >
-Blk MAllocator< id >::allocate(usize n)
+template < class Parent, usize budget, usize... classes >
+Blk SizeClassBank< Parent, budget, classes... >::allocate(usize n)
 {
-  Blk r;
-  r.ptr = std::malloc(n * sizeof(char));
-  r.size = n;
-
+  if(n > maxSize_)
+  {
+    return Parent::allocate(n);
+  }
+  const usize c = table_.index_[(n + granule_ - 1) / granule_];
+  Node* node = this->roots_[c];
+  if(node)
+  {
+    this->roots_[c] = node->next;
+    ++(this->countDown_[c]);
+    return {static_cast< void* >(node), n};
+  }
+  // the parent block holds any size of the class, so it can be recycled
+  Blk r = Parent::allocate(sizes_[c]);
+  r.size = r.ptr ? n : 0;
   return r;
 }
 
 // deallocate chunk described by block
 // @param b memory block
-template < u8 id >
-void MAllocator< id >::deallocate(Blk b)
+template < class Parent, usize budget, usize... classes >
+void SizeClassBank< Parent, budget, classes... >::deallocate(Blk b)
 {
-  std::free(b.ptr);
+  if(b.size > maxSize_)
+  {
+    Parent::deallocate(b);
+    return;
+  }
+  const usize c = table_.index_[(b.size + granule_ - 1) / granule_];
+  if(!this->countDown_[c])
+  {
+    Parent::deallocate({b.ptr, sizes_[c]});
+    return;
+  }
+  Node* node = static_cast< Node* >(b.ptr);
+  node->next = this->roots_[c];
+  this->roots_[c] = node;
+  --(this->countDown_[c]);
 }
 
 // check if the chunk is owned by this allocator
 // @param b memory block
 // @return true -> owns | false -> does not own
-template < u8 id >
-bool MAllocator< id >::owns(Blk b)
+template < class Parent, usize budget, usize... classes >
+bool SizeClassBank< Parent, budget, classes... >::owns(Blk b)
 {
-  // no way to control this
-  // other allocators should use this as fall back or provider
-  return false;
+  if(b.size > maxSize_)
+  {
+    return Parent::owns(b);
+  }
+  return Parent::owns({b.ptr, sizes_[table_.index_[(b.size + granule_ - 1) / granule_]]});
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// Stack: Use static array (compile time allocation)
-// and stack semantics to allocate memory
+// AtomicFreelist: lock free Freelist, shared among threads
 ///////////////////////////////////////////////////////////////////////////////
 
-template < usize size, usize minBlock >
-class StackAllocator
+// the same list of previous allocations as Freelist, pushed and popped with
+// a CAS on a tagged root: the lower 48 bits hold the node address and the
+// upper 16 bits a counter bumped by every pop, so a root that was popped
+// and pushed back in the meantime (ABA) no longer compares equal.
+// the parent is only called when the list is empty or full, under a spin
+// lock, so it needs not be thread safe.
+// a block whose address does not fit in 48 bits (e.g. 5 level paging) can
+// not be tagged, it goes back to the parent instead of to the list.
+// NOTE: a pop may read the next link of a node another thread just took, so
+// blocks given back to the parent must stay mapped (true of malloc and of
+// the arena allocators).
+template < class Parent, usize minSize, usize maxSize, usize maxBlocks >
+class AtomicFreelist : private Parent
 {
 public:
-  StackAllocator()
-      : data_{}
-      , pointer_{data_}
+  static_assert(sizeof(void*) == 8, "tagged pointers need 64 bit addresses");
+  static_assert(maxBlocks > 0, "an empty list only adds overhead");
+
+  AtomicFreelist()
+      : Parent()
+      , root_{0}
+      , countDown_{maxBlocks}
+      , locked_{0}
   {
   }
+
   Blk allocate(usize n);
   void deallocate(Blk b);
   bool owns(Blk b);
 
 private:
-  StackAllocator(StackAllocator& other) = delete;
-  StackAllocator& operator=(const StackAllocator& other) = delete;
+  AtomicFreelist(AtomicFreelist& other) = delete;
+  AtomicFreelist& operator=(AtomicFreelist& other) = delete;
+  // NOTE: next is atomic because a pop may read it while the node owner
+  // writes the block. a node is constructed in the block when it is pushed,
+  // default initialized: that writes nothing a stale pop could be reading
+  struct Node
+  {
+    std::atomic< Node* > next;
+  };
+  static_assert(std::is_trivially_default_constructible< Node >::value,
+                "constructing a node must not write the block");
 
-  char data_[size];
-  char* pointer_;
+  GLOBAL const u64 pointerMask_{(u64(1) << 48) - 1};
+  GLOBAL const u64 tagUnit_{u64(1) << 48};
+
+  void lock();
+  void unlock();
+
+  std::atomic< u64 > root_; // tag | node address
+  std::atomic< usize > countDown_;
+  std::atomic< u32 > locked_;
 };
 
+// GLOBAL
+template < class Parent, usize minSize, usize maxSize, usize maxBlocks >
+const u64 AtomicFreelist< Parent, minSize, maxSize, maxBlocks >::pointerMask_;
+template < class Parent, usize minSize, usize maxSize, usize maxBlocks >
+const u64 AtomicFreelist< Parent, minSize, maxSize, maxBlocks >::tagUnit_;
+
+// spin until the parent is ours
+template < class Parent, usize minSize, usize maxSize, usize maxBlocks >
+void AtomicFreelist< Parent, minSize, maxSize, maxBlocks >::lock()
+{
+  while(this->locked_.exchange(1, std::memory_order_acquire))
+  {
+    while(this->locked_.load(std::memory_order_relaxed))
+    {
+      cpuRelax();
+    }
+  }
+}
+
+template < class Parent, usize minSize, usize maxSize, usize maxBlocks >
+void AtomicFreelist< Parent, minSize, maxSize, maxBlocks >::unlock()
+{
+  this->locked_.store(0, std::memory_order_release);
+}
+
 // allocate chunk of certain size into memory block
 // @param n size of memory chunk
 // @return allocated memory block
-template < usize size, usize minBlock >
-Blk StackAllocator< size, minBlock >::allocate(usize n)
+template < class Parent, usize minSize, usize maxSize, usize maxBlocks >
+Blk AtomicFreelist< Parent, minSize, maxSize, maxBlocks >::allocate(usize n)
 {
-  auto nn = std::max(roundToPow2(n), minBlock);
-  if(nn > (data_ + size) - pointer_)
+  if(n >= minSize && n <= maxSize)
   {
-    return {nullptr, 0};
+    u64 root = this->root_.load(std::memory_order_acquire);
+    while(root & pointerMask_)
+    {
+      Node* node = reinterpret_cast< Node* >(root & pointerMask_);
+      const u64 next = reinterpret_cast< u64 >(node->next.load(std::memory_order_relaxed)) |
+                       ((root & ~pointerMask_) + tagUnit_);
+      if(this->root_.compare_exchange_weak(
+             root, next, std::memory_order_acquire, std::memory_order_acquire))
+      {
+        this->countDown_.fetch_add(1, std::memory_order_relaxed);
+        return {static_cast< void* >(node), n};
+      }
+    }
   }
-  Blk result = {pointer_, n};
-  pointer_ += nn;
-  return result;
+  this->lock();
+  // the parent gets block sizes of the whole range, so blocks can be reused
+  Blk r = Parent::allocate((n >= minSize && n <= maxSize) ? maxSize : n);
+  this->unlock();
+  r.size = r.ptr ? n : 0;
+  return r;
 }
 
 // deallocate chunk described by block
 // @param b memory block
-template < usize size, usize minBlock >
-void StackAllocator< size, minBlock >::deallocate(Blk b)
+template < class Parent, usize minSize, usize maxSize, usize maxBlocks >
+void AtomicFreelist< Parent, minSize, maxSize, maxBlocks >::deallocate(Blk b)
 {
-  if(static_cast< char* >(b.ptr) + roundToPow2(b.size) == pointer_)
+  if(b.size >= minSize && b.size <= maxSize)
   {
-    pointer_ = static_cast< char* >(b.ptr);
+    // reserve room in the list
+    usize countDown = 0;
+    if((reinterpret_cast< u64 >(b.ptr) & ~pointerMask_) == 0)
+    {
+      countDown = this->countDown_.load(std::memory_order_relaxed);
+      while(countDown && !this->countDown_.compare_exchange_weak(
+                             countDown, countDown - 1, std::memory_order_relaxed))
+      {
+      }
+    }
+    if(countDown)
+    {
+      Node* node = new(b.ptr) Node;
+      u64 root = this->root_.load(std::memory_order_relaxed);
+      u64 top;
+      do
+      {
+        node->next.store(reinterpret_cast< Node* >(root & pointerMask_), std::memory_order_relaxed);
+        top = reinterpret_cast< u64 >(node) | (root & ~pointerMask_);
+      } while(!this->root_.compare_exchange_weak(
+          root, top, std::memory_order_release, std::memory_order_relaxed));
+      return;
+    }
+    b.size = maxSize;
   }
+  this->lock();
+  Parent::deallocate(b);
+  this->unlock();
 }
 
 // check if the chunk is owned by this allocator
 // @param b memory block
 // @return true -> owns | false -> does not own
-template < usize size, usize minBlock >
-bool StackAllocator< size, minBlock >::owns(Blk b)
+template < class Parent, usize minSize, usize maxSize, usize maxBlocks >
+bool AtomicFreelist< Parent, minSize, maxSize, maxBlocks >::owns(Blk b)
 {
-  return b.ptr >= this->data_ && b.ptr < this->data_ + size;
+  if(b.size >= minSize && b.size <= maxSize)
+  {
+    return true;
+  }
+  this->lock();
+  const bool r = Parent::owns(b);
+  this->unlock();
+  return r;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// BitMapAllocator: uses malloc to get a big chunck and manages its use
-// in a memory pool using a bitmap
+// MAllocator: simple wraper around malloc to keep the interface consistent
 ///////////////////////////////////////////////////////////////////////////////
 
-// TODO: change to allow allocating a range of chunk sizes!
-template < usize size, usize block >
-class BitMapAllocator
+// if Mallocator is used more than once in an allocator composite, the id of each
+// component MAllocator has to be different to avoid ambiguity @ template resolution
+template < u8 id >
+class MAllocator
 {
 public:
-  BitMapAllocator()
-      : data_{nullptr}
-      , pointer_{nullptr}
-      , freeChuncks_{0}
-      , map_{}
-  {
-    this->freeChuncks_ = static_cast< u32 >(size / block);
-    this->data_ = static_cast< char* >(std::calloc(size, sizeof(char)));
-    this->pointer = this->data_;
-    std::fill(this->map, this->map + this->freeChuncks_, 0);
-  }
-  ~BitMapAllocator()
-  {
-    assert(this->freeChuncks_ == static_cast< u32 >(size / block));
-    std::free(static_cast< void* >(this->data_));
-  }
-
+  MAllocator() {}
   Blk allocate(usize n);
   void deallocate(Blk b);
   bool owns(Blk b);
 
 private:
-  BitMapAllocator(BitMapAllocator& other) = delete;
-  BitMapAllocator& operator=(const BitMapAllocator& other) = delete;
-
-  char* data_;
-  char* pointer_;
-  u32 freeChuncks_;
-  u8 map_[static_cast< u32 >(size / block) >> 3];
-
-  const u8 bitMask[8] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+  MAllocator(MAllocator& other) = delete;
+  MAllocator& operator=(const MAllocator& other) = delete;
 };
 
 // allocate chunk of certain size into memory block
 // @param n size of memory chunk
 // @return allocated memory block
-template < usize size, usize block >
-Blk BitMapAllocator< size, block >::allocate(usize n)
+template < u8 id >
+Blk MAllocator< id >::allocate(usize n)
 {
-  usize nn = roundToPow2(n);
-  if(nn == block && this->freeChuncks_)
-  {
-    Blk r;
-    // free block at the end of the chunk
-    if(this->pointer_ < (this->data_ + size))
-    {
-      r.ptr = static_cast< void* >(this->pointer_);
-      r.size = n;
-      u32 offset = static_cast< u32 >((this->pointer_ - this->data_) / block);
-      u8 bitset = offset % 8;
-      offset = offset >> 3;
-      this->map_[offset] |= bitMask[bitset];
-      this->pointer_ += nn;
-      --(this->freeChuncks_);
-      return r;
-    }
-    else
-    // needs to find a free block
-    {
-      int offset = 0;
-      for(; offset < (static_cast< u32 >(size / block) >> 3); ++offset)
-      {
-        u8 bmap = this->map_[offset];
-        if(bmap < 0xff)
-        {
-          u8 rev = ~bmap;
-          u8 bitset = 0x07;
-          while(bitset <= 0x00)
-          {
-            u8 mask = bitMask[bitset];
-            if(mask & rev)
-            {
-              u32 delta = (offset << 3);
-              delta += bitset;
-              r.ptr = static_cast< void* >(this->data_ + delta);
-              r.size = n;
-              this->pointer_ += nn;
-              this->map_[offset] |= mask;
-              --(this->freeChuncks_);
-              return r;
-            }
-            --bitset;
-          }
-        }
-      }
-    }
-  }
-  return {nullptr, 0};
+  Blk r;
+  r.ptr = std::malloc(n * sizeof(char));
+  r.size = n;
+
+  return r;
 }
 
 // deallocate chunk described by block
 // @param b memory block
-template < usize size, usize block >
-void BitMapAllocator< size, block >::deallocate(Blk b)
+template < u8 id >
+void MAllocator< id >::deallocate(Blk b)
 {
-  u32 offset = static_cast< u32 >((static_cast< char* >(b.ptr) - this->data_) / block);
-  u8 bitset = offset % 8;
-  offset = offset >> 3;
-  this->map_[offset] &= (~bitMask[bitset]);
+  std::free(b.ptr);
 }
 
 // check if the chunk is owned by this allocator
 // @param b memory block
 // @return true -> owns | false -> does not own
-template < usize size, usize block >
-bool BitMapAllocator< size, block >::owns(Blk b)
+template < u8 id >
+bool MAllocator< id >::owns(Blk b)
 {
-  return static_cast< char* >(b.ptr) >= data_ && static_cast< char* >(b.ptr) < this->data_ + size;
+  // no way to control this
+  // other allocators should use this as fall back or provider
+  return false;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+///////////////////////////////////////////////////////////////////////////////
+// MmapArena: stack semantics over address space reserved with mmap
+///////////////////////////////////////////////////////////////////////////////
+
+// the StackAllocator contract without storing the arena in the object:
+// - size bytes of address space are reserved when the arena is built, the
+//   pages are only committed by the OS when first touched, so an arena of
+//   GBs costs nothing until used (and the object is a few pointers).
+// - with hugePages the arena is backed by 2 MB pages: MAP_HUGETLB when the
+//   system has huge pages reserved, else transparent huge pages are asked
+//   for (madvise MADV_HUGEPAGE) on a 2 MB aligned range. fewer, larger
+//   pages mean far fewer TLB misses over a large working set.
+// usable as the Parent of Freelist / Selector or in place of MAllocator.
+// blocks are 16 byte aligned, only the top-most block is reclaimed on free.
+template < usize size, bool hugePages = true >
+class MmapArena
+{
+public:
+  GLOBAL const usize align_{16};
+  GLOBAL const usize hugePage_{usize(1) << 21};
+
+  MmapArena();
+  ~MmapArena();
+  Blk allocate(usize n);
+  void deallocate(Blk b);
+  bool owns(Blk b);
+
+private:
+  MmapArena(MmapArena& other) = delete;
+  MmapArena& operator=(const MmapArena& other) = delete;
+
+  void* mapping_; // whole mapping (may start before data_)
+  usize mapSize_;
+  char* data_;
+  char* pointer_;
+};
+
+// GLOBAL
+template < usize size, bool hugePages >
+const usize MmapArena< size, hugePages >::align_;
+template < usize size, bool hugePages >
+const usize MmapArena< size, hugePages >::hugePage_;
+
+// reserve the address space (data_ stays nullptr when mmap fails)
+template < usize size, bool hugePages >
+MmapArena< size, hugePages >::MmapArena()
+    : mapping_{nullptr}
+    , mapSize_{0}
+    , data_{nullptr}
+    , pointer_{nullptr}
+{
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+  void* mapping = MAP_FAILED;
+  usize mapSize = size;
+
+  if(hugePages)
+  {
+    mapSize = ((size + hugePage_ - 1) / hugePage_) * hugePage_;
+#if defined(MAP_HUGETLB)
+    // NOTE: no MAP_NORESERVE, the mapping must fail (rather than fault on
+    // first touch) when the system has not enough huge pages reserved
+    mapping = ::mmap(nullptr,
+                     mapSize,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                     -1,
+                     0);
+#endif
+    if(mapping == MAP_FAILED)
+    {
+      // room to align the arena on a huge page
+      mapSize += hugePage_;
+    }
+  }
+  if(mapping == MAP_FAILED)
+  {
+    mapping = ::mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if(mapping == MAP_FAILED)
+    {
+      return;
+    }
+  }
+
+  this->mapping_ = mapping;
+  this->mapSize_ = mapSize;
+  this->data_ = static_cast< char* >(mapping);
+  if(hugePages && mapSize > size + hugePage_ - 1)
+  {
+    const usize base = reinterpret_cast< usize >(mapping);
+    this->data_ = reinterpret_cast< char* >((base + hugePage_ - 1) & ~(hugePage_ - 1));
+#if defined(MADV_HUGEPAGE)
+    ::madvise(this->data_, mapSize - (this->data_ - static_cast< char* >(mapping)), MADV_HUGEPAGE);
+#endif
+  }
+  this->pointer_ = this->data_;
+}
+
+template < usize size, bool hugePages >
+MmapArena< size, hugePages >::~MmapArena()
+{
+  if(this->mapping_)
+  {
+    ::munmap(this->mapping_, this->mapSize_);
+  }
+}
+
+// allocate chunk of certain size into memory block
+// @param n size of memory chunk
+// @return allocated memory block
+template < usize size, bool hugePages >
+Blk MmapArena< size, hugePages >::allocate(usize n)
+{
+  const usize nn = ((n + align_ - 1) / align_) * align_;
+  if(!this->data_ || nn > static_cast< usize >((this->data_ + size) - this->pointer_))
+  {
+    return {nullptr, 0};
+  }
+  Blk result = {this->pointer_, n};
+  this->pointer_ += nn;
+  return result;
+}
+
+// deallocate chunk described by block
+// @param b memory block
+template < usize size, bool hugePages >
+void MmapArena< size, hugePages >::deallocate(Blk b)
+{
+  if(static_cast< char* >(b.ptr) + ((b.size + align_ - 1) / align_) * align_ == this->pointer_)
+  {
+    this->pointer_ = static_cast< char* >(b.ptr);
+  }
+}
+
+// check if the chunk is owned by this allocator
+// @param b memory block
+// @return true -> owns | false -> does not own
+template < usize size, bool hugePages >
+bool MmapArena< size, hugePages >::owns(Blk b)
+{
+  return this->data_ && b.ptr >= this->data_ && b.ptr < this->data_ + size;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Stack: Use static array (compile time allocation)
+// and stack semantics to allocate memory
+///////////////////////////////////////////////////////////////////////////////
+
+template < usize size, usize minBlock >
+class StackAllocator
+{
+public:
+  StackAllocator()
+      : data_{}
+      , pointer_{data_}
+  {
+  }
+  Blk allocate(usize n);
+  void deallocate(Blk b);
+  bool owns(Blk b);
+
+private:
+  StackAllocator(StackAllocator& other) = delete;
+  StackAllocator& operator=(const StackAllocator& other) = delete;
+
+  char data_[size];
+  char* pointer_;
+};
+
+// allocate chunk of certain size into memory block
+// @param n size of memory chunk
+// @return allocated memory block
+template < usize size, usize minBlock >
+Blk StackAllocator< size, minBlock >::allocate(usize n)
+{
+  auto nn = std::max(roundToPow2(n), minBlock);
+  if(nn > (data_ + size) - pointer_)
+  {
+    return {nullptr, 0};
+  }
+  Blk result = {pointer_, n};
+  pointer_ += nn;
+  return result;
+}
+
+// deallocate chunk described by block
+// @param b memory block
+template < usize size, usize minBlock >
+void StackAllocator< size, minBlock >::deallocate(Blk b)
+{
+  if(static_cast< char* >(b.ptr) + roundToPow2(b.size) == pointer_)
+  {
+    pointer_ = static_cast< char* >(b.ptr);
+  }
+}
+
+// check if the chunk is owned by this allocator
+// @param b memory block
+// @return true -> owns | false -> does not own
+template < usize size, usize minBlock >
+bool StackAllocator< size, minBlock >::owns(Blk b)
+{
+  return b.ptr >= this->data_ && b.ptr < this->data_ + size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CoalescingAllocator: static array with boundary tags, merges free blocks
+///////////////////////////////////////////////////////////////////////////////
+
+// unlike the StackAllocator any block can be freed at any time:
+// - every block has its size (and a used bit) in a header and in a footer,
+//   so a freed block finds both neighbours in constant time and is merged
+//   with the free ones, free space is always kept in the largest chunks.
+// - free blocks are kept in one list per power of 2 size range and a bit
+//   mask tells which lists are not empty, so the search for a large enough
+//   block is a scan of a single list or a bit scan.
+// blocks are 16 byte aligned and carry 16 bytes of tags.
+template < usize size >
+class CoalescingAllocator
+{
+public:
+  GLOBAL const usize align_{16};
+  GLOBAL const usize minChunk_{32}; // tags and free list links
+  GLOBAL const usize bins_{64};
+
+  CoalescingAllocator();
+  Blk allocate(usize n);
+  void deallocate(Blk b);
+  bool owns(Blk b);
+
+private:
+  CoalescingAllocator(CoalescingAllocator& other) = delete;
+  CoalescingAllocator& operator=(const CoalescingAllocator& other) = delete;
+
+  // links of a free chunk, right after its header
+  struct FreeChunk
+  {
+    FreeChunk* next;
+    FreeChunk* prev;
+  };
+
+  static usize binOf(usize chunk);
+  static usize& header(char* chunk);
+  static usize& footer(char* chunk, usize chunkSize);
+  void mark(char* chunk, usize chunkSize, bool used);
+  void link(char* chunk, usize chunkSize);
+  void unlink(char* chunk, usize chunkSize);
+
+  alignas(16) char data_[size];
+  char* first_; // first chunk (header)
+  char* end_;   // past the last chunk
+  u64 binMask_; // bit b set -> bin b not empty
+  FreeChunk* freeLists_[bins_];
+};
+
+// GLOBAL
+template < usize size >
+const usize CoalescingAllocator< size >::align_;
+template < usize size >
+const usize CoalescingAllocator< size >::minChunk_;
+template < usize size >
+const usize CoalescingAllocator< size >::bins_;
+
+// NOTE: chunks start 8 bytes into an aligned slot, so the payload that
+// follows the 8 byte header is aligned
+template < usize size >
+CoalescingAllocator< size >::CoalescingAllocator()
+    : first_{data_ + sizeof(usize)}
+    , end_{data_ + sizeof(usize) + ((size - sizeof(usize)) / align_) * align_}
+    , binMask_{0}
+    , freeLists_{}
+{
+  static_assert(size >= 64, "the arena holds at least a couple of chunks");
+  const usize chunkSize = this->end_ - this->first_;
+  this->mark(this->first_, chunkSize, false);
+  this->link(this->first_, chunkSize);
+}
+
+// list of the chunks of a size
+// @param chunk chunk size (at least minChunk_)
+// @return bin index (log2 of the size)
+template < usize size >
+usize CoalescingAllocator< size >::binOf(usize chunk)
+{
+  return 63 - countLeadingZeros(chunk);
+}
+
+// size and used bit of a chunk
+template < usize size >
+usize& CoalescingAllocator< size >::header(char* chunk)
+{
+  return *reinterpret_cast< usize* >(chunk);
+}
+
+// copy of the header at the end of the chunk
+template < usize size >
+usize& CoalescingAllocator< size >::footer(char* chunk, usize chunkSize)
+{
+  return *reinterpret_cast< usize* >(chunk + chunkSize - sizeof(usize));
+}
+
+// write the boundary tags of a chunk
+template < usize size >
+void CoalescingAllocator< size >::mark(char* chunk, usize chunkSize, bool used)
+{
+  header(chunk) = chunkSize | (used ? 0x01 : 0x00);
+  footer(chunk, chunkSize) = chunkSize | (used ? 0x01 : 0x00);
+}
+
+// add a free chunk to its bin
+template < usize size >
+void CoalescingAllocator< size >::link(char* chunk, usize chunkSize)
+{
+  const usize bin = binOf(chunkSize);
+  FreeChunk* node = reinterpret_cast< FreeChunk* >(chunk + sizeof(usize));
+  node->prev = nullptr;
+  node->next = this->freeLists_[bin];
+  if(node->next)
+  {
+    node->next->prev = node;
+  }
+  this->freeLists_[bin] = node;
+  this->binMask_ |= (u64(1) << bin);
+}
+
+// take a free chunk out of its bin
+template < usize size >
+void CoalescingAllocator< size >::unlink(char* chunk, usize chunkSize)
+{
+  const usize bin = binOf(chunkSize);
+  FreeChunk* node = reinterpret_cast< FreeChunk* >(chunk + sizeof(usize));
+  if(node->prev)
+  {
+    node->prev->next = node->next;
+  }
+  else
+  {
+    this->freeLists_[bin] = node->next;
+    if(!node->next)
+    {
+      this->binMask_ &= ~(u64(1) << bin);
+    }
+  }
+  if(node->next)
+  {
+    node->next->prev = node->prev;
+  }
+}
+
+// allocate chunk of certain size into memory block
+// NOTE: first fit in the bin of the size, else any chunk of a larger bin,
+// the rest of the chunk goes back to the bins when it can hold a chunk
+// @param n size of memory chunk
+// @return allocated memory block
+template < usize size >
+Blk CoalescingAllocator< size >::allocate(usize n)
+{
+  if(n > size)
+  {
+    return {nullptr, 0};
+  }
+  const usize need =
+      std::max(((n + 2 * sizeof(usize) + align_ - 1) / align_) * align_, minChunk_);
+
+  char* chunk = nullptr;
+  usize chunkSize = 0;
+  const usize bin = binOf(need);
+  for(FreeChunk* node = this->freeLists_[bin]; node; node = node->next)
+  {
+    char* candidate = reinterpret_cast< char* >(node) - sizeof(usize);
+    if(header(candidate) >= need)
+    {
+      chunk = candidate;
+      chunkSize = header(candidate);
+      break;
+    }
+  }
+  if(!chunk)
+  {
+    const u64 larger = (bin + 1 < bins_) ? (this->binMask_ >> (bin + 1)) << (bin + 1) : 0;
+    if(!larger)
+    {
+      return {nullptr, 0};
+    }
+    chunk = reinterpret_cast< char* >(this->freeLists_[countTrailingZeros(larger)]) - sizeof(usize);
+    chunkSize = header(chunk);
+  }
+
+  this->unlink(chunk, chunkSize);
+  if(chunkSize - need >= minChunk_)
+  {
+    this->mark(chunk + need, chunkSize - need, false);
+    this->link(chunk + need, chunkSize - need);
+    chunkSize = need;
+  }
+  this->mark(chunk, chunkSize, true);
+  return {static_cast< void* >(chunk + sizeof(usize)), n};
+}
+
+// deallocate chunk described by block
+// NOTE: the chunk is merged with its free neighbours
+// @param b memory block
+template < usize size >
+void CoalescingAllocator< size >::deallocate(Blk b)
+{
+  char* chunk = static_cast< char* >(b.ptr) - sizeof(usize);
+  usize chunkSize = header(chunk) & ~usize(0x01);
+  assert(header(chunk) & 0x01);
+
+  char* next = chunk + chunkSize;
+  if(next < this->end_ && !(header(next) & 0x01))
+  {
+    this->unlink(next, header(next));
+    chunkSize += header(next);
+  }
+  if(chunk > this->first_)
+  {
+    const usize prevTag = *reinterpret_cast< usize* >(chunk - sizeof(usize));
+    if(!(prevTag & 0x01))
+    {
+      chunk -= prevTag;
+      this->unlink(chunk, prevTag);
+      chunkSize += prevTag;
+    }
+  }
+  this->mark(chunk, chunkSize, false);
+  this->link(chunk, chunkSize);
+}
+
+// check if the chunk is owned by this allocator
+// @param b memory block
+// @return true -> owns | false -> does not own
+template < usize size >
+bool CoalescingAllocator< size >::owns(Blk b)
+{
+  return b.ptr >= this->data_ && b.ptr < this->data_ + size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// BuddyAllocator: static array split in power of 2 blocks, merged on free
+///////////////////////////////////////////////////////////////////////////////
+
+// the arena is a binary tree of blocks: level 0 is the whole arena and each
+// level halves the block size down to minBlock.
+// - allocate takes a free block of the smallest level that fits, splitting
+//   a larger one (one halving per level) when none is free.
+// - deallocate merges the block with its buddy while the buddy is free.
+// split and free state are bitmaps over the tree nodes (heap order: node 1
+// is the root, the children of node k are 2k and 2k + 1), free blocks are
+// also linked in a list per level and a mask tells which lists are not
+// empty. split, merge and the walk that finds the level of a freed block
+// are O(log n), the waste is bounded by the power of 2 rounding.
+// size and minBlock must be powers of 2, minBlock >= 16.
+template < usize size, usize minBlock >
+class BuddyAllocator
+{
+public:
+  GLOBAL const usize levels_{sizeClassCount(minBlock, size)};
+  GLOBAL const usize nodes_{usize(1) << levels_}; // node 0 unused
+
+  BuddyAllocator();
+  Blk allocate(usize n);
+  void deallocate(Blk b);
+  bool owns(Blk b);
+
+private:
+  BuddyAllocator(BuddyAllocator& other) = delete;
+  BuddyAllocator& operator=(const BuddyAllocator& other) = delete;
+
+  struct FreeBlock
+  {
+    FreeBlock* next;
+    FreeBlock* prev;
+  };
+
+  static bool test(const u64* bits, usize node);
+  static void set(u64* bits, usize node);
+  static void reset(u64* bits, usize node);
+  char* blockOf(usize level, usize node);
+  void push(usize level, usize node);
+  void pop(usize level, usize node);
+
+  alignas(64) char data_[size];
+  u64 split_[(nodes_ + 63) / 64];
+  u64 free_[(nodes_ + 63) / 64];
+  u64 levelMask_; // bit l set -> level l list not empty
+  FreeBlock* lists_[levels_];
+};
+
+// GLOBAL
+template < usize size, usize minBlock >
+const usize BuddyAllocator< size, minBlock >::levels_;
+template < usize size, usize minBlock >
+const usize BuddyAllocator< size, minBlock >::nodes_;
+
+template < usize size, usize minBlock >
+BuddyAllocator< size, minBlock >::BuddyAllocator()
+    : split_{}
+    , free_{}
+    , levelMask_{0}
+    , lists_{}
+{
+  static_assert((size & (size - 1)) == 0 && (minBlock & (minBlock - 1)) == 0,
+                "size and minBlock must be powers of 2");
+  static_assert(minBlock >= sizeof(FreeBlock) && minBlock <= size, "16 <= minBlock <= size");
+  static_assert(levels_ <= 64, "level mask holds 64 levels");
+  this->push(0, 1);
+}
+
+template < usize size, usize minBlock >
+bool BuddyAllocator< size, minBlock >::test(const u64* bits, usize node)
+{
+  return (bits[node >> 6] >> (node & 63)) & 0x01;
+}
+
+template < usize size, usize minBlock >
+void BuddyAllocator< size, minBlock >::set(u64* bits, usize node)
+{
+  bits[node >> 6] |= (u64(1) << (node & 63));
+}
+
+template < usize size, usize minBlock >
+void BuddyAllocator< size, minBlock >::reset(u64* bits, usize node)
+{
+  bits[node >> 6] &= ~(u64(1) << (node & 63));
+}
+
+// memory of a tree node
+// @param level level of the node
+// @param node  node index (heap order)
+// @return first byte of the block
+template < usize size, usize minBlock >
+char* BuddyAllocator< size, minBlock >::blockOf(usize level, usize node)
+{
+  return this->data_ + (node - (usize(1) << level)) * (size >> level);
+}
+
+// mark a block free and add it to the list of its level
+template < usize size, usize minBlock >
+void BuddyAllocator< size, minBlock >::push(usize level, usize node)
+{
+  FreeBlock* block = reinterpret_cast< FreeBlock* >(this->blockOf(level, node));
+  block->prev = nullptr;
+  block->next = this->lists_[level];
+  if(block->next)
+  {
+    block->next->prev = block;
+  }
+  this->lists_[level] = block;
+  this->levelMask_ |= (u64(1) << level);
+  set(this->free_, node);
+}
+
+// mark a block used and take it out of the list of its level
+template < usize size, usize minBlock >
+void BuddyAllocator< size, minBlock >::pop(usize level, usize node)
+{
+  FreeBlock* block = reinterpret_cast< FreeBlock* >(this->blockOf(level, node));
+  if(block->prev)
+  {
+    block->prev->next = block->next;
+  }
+  else
+  {
+    this->lists_[level] = block->next;
+    if(!block->next)
+    {
+      this->levelMask_ &= ~(u64(1) << level);
+    }
+  }
+  if(block->next)
+  {
+    block->next->prev = block->prev;
+  }
+  reset(this->free_, node);
+}
+
+// allocate chunk of certain size into memory block
+// @param n size of memory chunk
+// @return allocated memory block
+template < usize size, usize minBlock >
+Blk BuddyAllocator< size, minBlock >::allocate(usize n)
+{
+  if(n > size)
+  {
+    return {nullptr, 0};
+  }
+  // deepest level whose blocks hold n
+  usize level = levels_ - 1;
+  while(level && (size >> level) < n)
+  {
+    --level;
+  }
+
+  // closest level at or above with a free block
+  const u64 candidates = this->levelMask_ & ((level == 63) ? ~u64(0) : (u64(2) << level) - 1);
+  if(!candidates)
+  {
+    return {nullptr, 0};
+  }
+  usize from = 63 - countLeadingZeros(candidates);
+  char* block = reinterpret_cast< char* >(this->lists_[from]);
+  usize node = (usize(1) << from) + (block - this->data_) / (size >> from);
+  this->pop(from, node);
+
+  // split down, the upper halves stay free
+  for(; from < level; from++)
+  {
+    set(this->split_, node);
+    node <<= 1;
+    this->push(from + 1, node + 1);
+  }
+  return {static_cast< void* >(block), n};
+}
+
+// deallocate chunk described by block
+// NOTE: the level of the block is found walking the split bits, the size
+// of the block is not needed
+// @param b memory block
+template < usize size, usize minBlock >
+void BuddyAllocator< size, minBlock >::deallocate(Blk b)
+{
+  const usize offset = static_cast< char* >(b.ptr) - this->data_;
+  usize level = 0;
+  usize node = 1;
+  while(test(this->split_, node))
+  {
+    ++level;
+    node = (usize(1) << level) + offset / (size >> level);
+  }
+  assert(!test(this->free_, node) && (size >> level) >= b.size);
+
+  // merge with the buddy while it is free
+  for(; level && test(this->free_, node ^ 0x01); --level)
+  {
+    this->pop(level, node ^ 0x01);
+    node >>= 1;
+    reset(this->split_, node);
+  }
+  this->push(level, node);
+}
+
+// check if the chunk is owned by this allocator
+// @param b memory block
+// @return true -> owns | false -> does not own
+template < usize size, usize minBlock >
+bool BuddyAllocator< size, minBlock >::owns(Blk b)
+{
+  return b.ptr >= this->data_ && b.ptr < this->data_ + size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// BitMapAllocator: uses malloc to get a big chunck and manages its use
+// in a memory pool using a bitmap
+///////////////////////////////////////////////////////////////////////////////
+
+// one bit per block (set -> used), searched a 64 bit word at a time:
+// - a free block is the lowest zero bit of the first word that is not full.
+// - a request larger than block takes a run of contiguous blocks, the run
+//   ends are found with bit scans as well.
+// - a summary bitmap has one bit per word of the map (set -> the word has a
+//   free block), so a free block is two bit scans away: the summary word
+//   gives the map word, the map word gives the block. runs skip full words
+//   through the summary as well.
+// - hint_ is the first summary word that may have a bit set (all the words
+//   before it are 0), so the search skips the full front of the pool.
+template < usize size, usize block >
+class BitMapAllocator
+{
+public:
+  GLOBAL const usize blocks_{size / block};
+  GLOBAL const usize words_{(blocks_ + 63) / 64};
+  GLOBAL const usize summaryWords_{(words_ + 63) / 64};
+
+  BitMapAllocator()
+      : data_{nullptr}
+      , freeChuncks_{blocks_}
+      , hint_{0}
+      , map_{}
+      , summary_{}
+  {
+    static_assert(blocks_ > 0, "the pool holds at least one block");
+    this->data_ = static_cast< char* >(std::calloc(size, sizeof(char)));
+    // the bits past the last block are never free
+    if(blocks_ % 64)
+    {
+      this->map_[words_ - 1] = ~u64(0) << (blocks_ % 64);
+    }
+    for(usize w = 0; w < words_; w++)
+    {
+      this->summary_[w >> 6] |= (u64(1) << (w & 63));
+    }
+  }
+  ~BitMapAllocator()
+  {
+    assert(this->freeChuncks_ == blocks_);
+    std::free(static_cast< void* >(this->data_));
+  }
+
+  Blk allocate(usize n);
+  void deallocate(Blk b);
+  bool owns(Blk b);
+
+private:
+  BitMapAllocator(BitMapAllocator& other) = delete;
+  BitMapAllocator& operator=(const BitMapAllocator& other) = delete;
+
+  usize findRun(usize count);
+  usize nextUsed(usize bit, usize limit);
+  usize nextFreeWord(usize word);
+  void markRun(usize first, usize count, bool used);
+
+  char* data_;
+  usize freeChuncks_;
+  usize hint_;
+  u64 map_[words_];
+  u64 summary_[summaryWords_];
+};
+
+// GLOBAL
+template < usize size, usize block >
+const usize BitMapAllocator< size, block >::blocks_;
+template < usize size, usize block >
+const usize BitMapAllocator< size, block >::words_;
+template < usize size, usize block >
+const usize BitMapAllocator< size, block >::summaryWords_;
+
+// first map word with a free block at or after word
+// @param word first map word to check
+// @return index of the word or words_ if every word after it is full
+template < usize size, usize block >
+usize BitMapAllocator< size, block >::nextFreeWord(usize word)
+{
+  usize s = word >> 6;
+  if(s >= summaryWords_)
+  {
+    return words_;
+  }
+  u64 free = this->summary_[s] & (~u64(0) << (word & 63));
+  while(!free)
+  {
+    if(++s >= summaryWords_)
+    {
+      return words_;
+    }
+    free = this->summary_[s];
+  }
+  return (s << 6) + countTrailingZeros(free);
+}
+
+// first used block at or after bit
+// @param bit   first block to check
+// @param limit block to stop at
+// @return index of the used block or limit if none is found before it
+template < usize size, usize block >
+usize BitMapAllocator< size, block >::nextUsed(usize bit, usize limit)
+{
+  usize w = bit >> 6;
+  u64 used = this->map_[w] & (~u64(0) << (bit & 63));
+  while(!used)
+  {
+    if(++w >= words_ || (w << 6) >= limit)
+    {
+      return limit;
+    }
+    used = this->map_[w];
+  }
+  return std::min((w << 6) + countTrailingZeros(used), limit);
+}
+
+// first run of free blocks
+// @param count number of contiguous blocks
+// @return index of the first block of the run or blocks_ if there is none
+template < usize size, usize block >
+usize BitMapAllocator< size, block >::findRun(usize count)
+{
+  usize bit = this->nextFreeWord(this->hint_ << 6) << 6;
+  while(bit + count <= blocks_)
+  {
+    usize w = bit >> 6;
+    const u64 free = ~this->map_[w] & (~u64(0) << (bit & 63));
+    if(!free)
+    {
+      w = this->nextFreeWord(w + 1);
+      bit = w << 6;
+      continue;
+    }
+    bit = (w << 6) + countTrailingZeros(free);
+    if(count == 1)
+    {
+      return bit;
+    }
+    const usize end = this->nextUsed(bit, bit + count);
+    if(end - bit >= count)
+    {
+      return bit;
+    }
+    bit = end;
+  }
+  return blocks_;
+}
+
+// set or clear the bits of a run of blocks
+// @param first first block of the run
+// @param count number of blocks
+// @param used  true -> mark used | false -> mark free
+template < usize size, usize block >
+void BitMapAllocator< size, block >::markRun(usize first, usize count, bool used)
+{
+  while(count)
+  {
+    const usize w = first >> 6;
+    const usize shift = first & 63;
+    const usize bits = std::min(count, 64 - shift);
+    const u64 mask = ((bits == 64) ? ~u64(0) : ((u64(1) << bits) - 1)) << shift;
+    if(used)
+    {
+      this->map_[w] |= mask;
+    }
+    else
+    {
+      this->map_[w] &= ~mask;
+    }
+    if(~this->map_[w])
+    {
+      this->summary_[w >> 6] |= (u64(1) << (w & 63));
+    }
+    else
+    {
+      this->summary_[w >> 6] &= ~(u64(1) << (w & 63));
+    }
+    first += bits;
+    count -= bits;
+  }
+}
+
+// allocate chunk of certain size into memory block
+// NOTE: sizes above block take a run of contiguous blocks
+// @param n size of memory chunk
+// @return allocated memory block
+template < usize size, usize block >
+Blk BitMapAllocator< size, block >::allocate(usize n)
+{
+  const usize count = std::max((n + block - 1) / block, static_cast< usize >(1));
+  if(!this->data_ || count > this->freeChuncks_)
+  {
+    return {nullptr, 0};
+  }
+  const usize first = this->findRun(count);
+  if(first == blocks_)
+  {
+    return {nullptr, 0};
+  }
+  this->markRun(first, count, true);
+  this->freeChuncks_ -= count;
+  // a single block is the first free one, the summary words before it are 0
+  if(count == 1)
+  {
+    this->hint_ = first >> 12;
+  }
+  return {static_cast< void* >(this->data_ + first * block), n};
+}
+
+// deallocate chunk described by block
+// @param b memory block
+template < usize size, usize block >
+void BitMapAllocator< size, block >::deallocate(Blk b)
+{
+  const usize first = static_cast< usize >(static_cast< char* >(b.ptr) - this->data_) / block;
+  const usize count = std::max((b.size + block - 1) / block, static_cast< usize >(1));
+  this->markRun(first, count, false);
+  this->freeChuncks_ += count;
+  this->hint_ = std::min(this->hint_, first >> 12);
+}
+
+// check if the chunk is owned by this allocator
+// @param b memory block
+// @return true -> owns | false -> does not own
+template < usize size, usize block >
+bool BitMapAllocator< size, block >::owns(Blk b)
+{
+  return static_cast< char* >(b.ptr) >= data_ && static_cast< char* >(b.ptr) < this->data_ + size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ThreadCache: per thread magazines in front of a shared allocator
+///////////////////////////////////////////////////////////////////////////////
+
+// makes any allocator composite safe to share among threads:
+// - each thread keeps a magazine (list of free blocks) per power of 2 size
+//   class up to maxSize, allocate and deallocate only touch the magazine.
+// - an empty magazine refills from the class transfer list (blocks other
+//   threads flushed) or else takes a batch from the parent.
+// - a full magazine flushes half of it to the transfer list, or to the
+//   parent when the transfer list already holds enough blocks.
+// - transfer lists are lock free: batches are pushed with a CAS and taken
+//   all at once with an exchange, so there is no ABA problem. only the
+//   parent is guarded by a (spin) lock, taken once per batch.
+// a block freed by another thread than the one that allocated it simply
+// goes to the magazine of the freeing thread.
+// larger blocks go straight to the parent (under the lock).
+// NOTE: the magazines are thread_local per type, so there must be a single
+// instance per type (use id as with MAllocator) and it must outlive the
+// threads using it. a thread flushes its magazines when it exits.
+template < class Parent, u8 id, usize maxSize = 2048, usize magazineSize = 64 >
+class ThreadCache : private Parent
+{
+public:
+  GLOBAL const usize minSize_{16}; // smallest class (a block holds a Node)
+  GLOBAL const usize classes_{sizeClassCount(minSize_, maxSize)};
+  GLOBAL const usize batch_{magazineSize / 2}; // blocks moved at once
+  // blocks a transfer list keeps before flushes go back to the parent
+  GLOBAL const usize maxTransfer_{magazineSize * 8};
+
+  ThreadCache();
+  ~ThreadCache();
+
+  Blk allocate(usize n);
+  void deallocate(Blk b);
+  bool owns(Blk b);
+
+private:
+  ThreadCache(ThreadCache& other) = delete;
+  ThreadCache& operator=(const ThreadCache& other) = delete;
+
+  struct Node
+  {
+    Node* next;
+  };
+
+  struct Magazine
+  {
+    Node* head;
+    usize count;
+  };
+
+  // magazines of a thread, flushed when the thread exits
+  struct LocalCache
+  {
+    ThreadCache* owner;
+    Magazine magazines[classes_];
+
+    ~LocalCache();
+  };
+
+  static usize sizeClass(usize n);
+  Node* refill(usize sizeClass);
+  void flush(Magazine& magazine, usize sizeClass, usize amount);
+  void lock();
+  void unlock();
+
+  static thread_local LocalCache local_;
+
+  std::atomic< u32 > locked_;
+  std::atomic< Node* > transfer_[classes_];
+  std::atomic< usize > transferCount_[classes_];
+};
+
+// GLOBAL
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+const usize ThreadCache< Parent, id, maxSize, magazineSize >::minSize_;
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+const usize ThreadCache< Parent, id, maxSize, magazineSize >::classes_;
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+const usize ThreadCache< Parent, id, maxSize, magazineSize >::batch_;
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+const usize ThreadCache< Parent, id, maxSize, magazineSize >::maxTransfer_;
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+thread_local typename ThreadCache< Parent, id, maxSize, magazineSize >::LocalCache
+    ThreadCache< Parent, id, maxSize, magazineSize >::local_;
+
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+ThreadCache< Parent, id, maxSize, magazineSize >::ThreadCache()
+    : Parent()
+    , locked_{0}
+{
+  static_assert(magazineSize >= 2, "magazines move half of their blocks at once");
+  for(usize c = 0; c < classes_; c++)
+  {
+    this->transfer_[c].store(nullptr, std::memory_order_relaxed);
+    this->transferCount_[c].store(0, std::memory_order_relaxed);
+  }
+}
+
+// give every cached block back to the parent
+// NOTE: only the magazines of the calling thread are reachable, other
+// threads must have exited
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+ThreadCache< Parent, id, maxSize, magazineSize >::~ThreadCache()
+{
+  if(local_.owner == this)
+  {
+    for(usize c = 0; c < classes_; c++)
+    {
+      for(Node* node = local_.magazines[c].head; node;)
+      {
+        Node* next = node->next;
+        Parent::deallocate({static_cast< void* >(node), minSize_ << c});
+        node = next;
+      }
+      local_.magazines[c] = {nullptr, 0};
+    }
+    local_.owner = nullptr;
+  }
+  for(usize c = 0; c < classes_; c++)
+  {
+    for(Node* node = this->transfer_[c].exchange(nullptr); node;)
+    {
+      Node* next = node->next;
+      Parent::deallocate({static_cast< void* >(node), minSize_ << c});
+      node = next;
+    }
+  }
+}
+
+// flush the magazines of an exiting thread to the transfer lists
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+ThreadCache< Parent, id, maxSize, magazineSize >::LocalCache::~LocalCache()
+{
+  if(this->owner)
+  {
+    for(usize c = 0; c < classes_; c++)
+    {
+      this->owner->flush(this->magazines[c], c, this->magazines[c].count);
+    }
+  }
+}
+
+// size class of a block size
+// @param n size of memory chunk (at most maxSize)
+// @return class index, the class block size is minSize_ << index
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+usize ThreadCache< Parent, id, maxSize, magazineSize >::sizeClass(usize n)
+{
+  // log2(minSize_) == 4
+  return (n <= minSize_) ? 0 : (64 - countLeadingZeros(n - 1)) - 4;
+}
+
+// spin until the parent is ours
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+void ThreadCache< Parent, id, maxSize, magazineSize >::lock()
+{
+  while(this->locked_.exchange(1, std::memory_order_acquire))
+  {
+    while(this->locked_.load(std::memory_order_relaxed))
+    {
+      cpuRelax();
+    }
+  }
+}
+
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+void ThreadCache< Parent, id, maxSize, magazineSize >::unlock()
+{
+  this->locked_.store(0, std::memory_order_release);
+}
+
+// fill the empty magazine of a class
+// @param sizeClass class index
+// @return a block for the caller (nullptr if the parent is exhausted)
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+typename ThreadCache< Parent, id, maxSize, magazineSize >::Node*
+ThreadCache< Parent, id, maxSize, magazineSize >::refill(usize sizeClass)
+{
+  Magazine& magazine = local_.magazines[sizeClass];
+
+  // take whatever the other threads flushed
+  Node* node = this->transfer_[sizeClass].exchange(nullptr, std::memory_order_acquire);
+  if(node)
+  {
+    usize taken = 0;
+    for(Node* n = node; n; n = n->next)
+    {
+      ++taken;
+    }
+    this->transferCount_[sizeClass].fetch_sub(taken, std::memory_order_relaxed);
+    magazine.head = node->next;
+    magazine.count = taken - 1;
+    return node;
+  }
+
+  const usize blockSize = minSize_ << sizeClass;
+  this->lock();
+  for(usize b = 0; b < batch_; b++)
+  {
+    Node* block = static_cast< Node* >(Parent::allocate(blockSize).ptr);
+    if(!block)
+    {
+      break;
+    }
+    block->next = magazine.head;
+    magazine.head = block;
+    ++magazine.count;
+  }
+  this->unlock();
+
+  node = magazine.head;
+  if(node)
+  {
+    magazine.head = node->next;
+    --magazine.count;
+  }
+  return node;
+}
+
+// move blocks out of a magazine
+// @param magazine  magazine to flush
+// @param sizeClass class index
+// @param amount    number of blocks to move
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+void ThreadCache< Parent, id, maxSize, magazineSize >::flush(Magazine& magazine,
+                                                             usize sizeClass,
+                                                             usize amount)
+{
+  if(!amount)
+  {
+    return;
+  }
+  Node* first = magazine.head;
+  Node* last = first;
+  for(usize b = 1; b < amount; b++)
+  {
+    last = last->next;
+  }
+  magazine.head = last->next;
+  magazine.count -= amount;
+
+  if(this->transferCount_[sizeClass].load(std::memory_order_relaxed) < maxTransfer_)
+  {
+    this->transferCount_[sizeClass].fetch_add(amount, std::memory_order_relaxed);
+    Node* head = this->transfer_[sizeClass].load(std::memory_order_relaxed);
+    do
+    {
+      last->next = head;
+    } while(!this->transfer_[sizeClass].compare_exchange_weak(
+        head, first, std::memory_order_release, std::memory_order_relaxed));
+    return;
+  }
+
+  last->next = nullptr;
+  const usize blockSize = minSize_ << sizeClass;
+  this->lock();
+  for(Node* node = first; node;)
+  {
+    Node* next = node->next;
+    Parent::deallocate({static_cast< void* >(node), blockSize});
+    node = next;
+  }
+  this->unlock();
+}
+
+// allocate chunk of certain size into memory block
+// @param n size of memory chunk
+// @return allocated memory block
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+Blk ThreadCache< Parent, id, maxSize, magazineSize >::allocate(usize n)
+{
+  if(n > maxSize)
+  {
+    this->lock();
+    Blk r = Parent::allocate(n);
+    this->unlock();
+    return r;
+  }
+
+  if(local_.owner != this)
+  {
+    assert(!local_.owner);
+    local_.owner = this;
+  }
+  const usize c = sizeClass(n);
+  Magazine& magazine = local_.magazines[c];
+  Node* node = magazine.head;
+  if(node)
+  {
+    magazine.head = node->next;
+    --magazine.count;
+  }
+  else
+  {
+    node = this->refill(c);
+  }
+  if(!node)
+  {
+    return {nullptr, 0};
+  }
+  return {static_cast< void* >(node), n};
+}
+
+// deallocate chunk described by block
+// @param b memory block
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+void ThreadCache< Parent, id, maxSize, magazineSize >::deallocate(Blk b)
+{
+  if(b.size > maxSize)
+  {
+    this->lock();
+    Parent::deallocate(b);
+    this->unlock();
+    return;
+  }
+
+  if(local_.owner != this)
+  {
+    assert(!local_.owner);
+    local_.owner = this;
+  }
+  const usize c = sizeClass(b.size);
+  Magazine& magazine = local_.magazines[c];
+  if(magazine.count >= magazineSize)
+  {
+    this->flush(magazine, c, batch_);
+  }
+  Node* node = static_cast< Node* >(b.ptr);
+  node->next = magazine.head;
+  magazine.head = node;
+  ++magazine.count;
+}
+
+// check if the chunk is owned by this allocator
+// @param b memory block
+// @return true -> owns | false -> does not own
+template < class Parent, u8 id, usize maxSize, usize magazineSize >
+bool ThreadCache< Parent, id, maxSize, magazineSize >::owns(Blk b)
+{
+  this->lock();
+  const bool r = Parent::owns(b);
+  this->unlock();
+  return r;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
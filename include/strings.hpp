@@ -11,6 +11,7 @@
 
 #include "basic_types.hpp"
 #include "functions.hpp"
+#include "hash.hpp"
 
 namespace Montreal
 {
@@ -172,15 +173,19 @@ public:
   ~StringWrapper();
   explicit StringWrapper(StringPoolInterface* sp);
   explicit StringWrapper(StringPoolInterface* sp, const char* initStr);
-  StringWrapper(StringWrapper& otherStr);
+  StringWrapper(const StringWrapper& otherStr);
   // TODO: move constructor???
-  StringWrapper& operator=(StringWrapper& otherStr);
+  StringWrapper& operator=(const StringWrapper& otherStr);
   StringWrapper& operator=(const char* initStr); // copy on write
   const char operator[](u16 pos) const;
   char operator[](u16 pos); // copy on write
-  const char* cStr();
+  bool operator==(const StringWrapper& otherStr) const;
+  const char* cStr() const;
+  u16 length() const;
 
 private:
+  void release();
+
   // data
   StringPoolInterface* strPool_;
   u16 length_;
@@ -188,9 +193,26 @@ private:
   char* str_;
 };
 
-StringWrapper::~StringWrapper()
+StringWrapper::~StringWrapper() { this->release(); }
+
+// drop this reference to the pooled string (the last reference frees it)
+// NOTE: refCount_ counts the copies sharing the string besides the first one
+void StringWrapper::release()
 {
-  this->strPool_->deallocate(this->length_, this->str_, this->refCount_);
+  if(this->refCount_)
+  {
+    if(*this->refCount_)
+    {
+      --(*this->refCount_);
+    }
+    else
+    {
+      this->strPool_->deallocate(this->length_, this->str_, this->refCount_);
+    }
+    this->refCount_ = nullptr;
+    this->str_ = nullptr;
+    this->length_ = 0;
+  }
 }
 
 StringWrapper::StringWrapper(StringPoolInterface* sp, const char* initStr)
@@ -206,6 +228,7 @@ StringWrapper::StringWrapper(StringPoolInterface* sp, const char* initStr)
   {
     this->str_ = ret.str;
     this->refCount_ = ret.refCount;
+    this->length_ = inLen;
 
     std::copy_n(initStr, inLen, this->str_);
   }
@@ -219,33 +242,39 @@ StringWrapper::StringWrapper(StringPoolInterface* sp)
 {
 }
 
-StringWrapper::StringWrapper(StringWrapper& otherStr)
+StringWrapper::StringWrapper(const StringWrapper& otherStr)
     : strPool_{otherStr.strPool_}
     , length_{otherStr.length_}
     , refCount_{otherStr.refCount_}
     , str_{otherStr.str_}
 {
-  ++(*refCount_);
+  if(this->refCount_)
+  {
+    ++(*this->refCount_);
+  }
 }
 
-StringWrapper& StringWrapper::operator=(StringWrapper& otherStr)
+StringWrapper& StringWrapper::operator=(const StringWrapper& otherStr)
 {
-  this->strPool_ = otherStr.strPool_;
-  this->length_ = otherStr.length_;
-  this->str_ = otherStr.str_;
-
-  this->refCount_ = otherStr.refCount_;
-  ++(*refCount_);
+  if(this != &otherStr)
+  {
+    this->release();
+    this->strPool_ = otherStr.strPool_;
+    this->length_ = otherStr.length_;
+    this->str_ = otherStr.str_;
 
+    this->refCount_ = otherStr.refCount_;
+    if(this->refCount_)
+    {
+      ++(*this->refCount_);
+    }
+  }
   return *this;
 }
 
 StringWrapper& StringWrapper::operator=(const char* initStr)
 {
-  if((*this->refCount_) > 1)
-  {
-    this->refCount_ -= 1;
-  }
+  this->release();
 
   u16 inLen = std::strlen(initStr);
   u16 len = std::max(static_cast< usize >(8), roundToPow2(inLen));
@@ -254,6 +283,7 @@ StringWrapper& StringWrapper::operator=(const char* initStr)
   {
     this->str_ = ret.str;
     this->refCount_ = ret.refCount;
+    this->length_ = inLen;
 
     std::copy_n(initStr, inLen, this->str_);
   }
@@ -287,7 +317,102 @@ char StringWrapper::operator[](u16 pos)
   return this->str_[index];
 }
 
-const char* StringWrapper::cStr() { return this->str_; }
+bool StringWrapper::operator==(const StringWrapper& otherStr) const
+{
+  return this->length_ == otherStr.length_ &&
+         (this->str_ == otherStr.str_ ||
+          std::equal(this->str_, (this->str_ + this->length_), otherStr.str_));
+}
+
+const char* StringWrapper::cStr() const { return this->str_; }
+
+u16 StringWrapper::length() const { return this->length_; }
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Static String : view of a string literal, usable at compile time
+///////////////////////////////////////////////////////////////////////////////
+
+// NOTE: does not own its characters (they must outlive it), meant for keys
+// of tables built at compile time (see StaticHashMap) and to look up
+// StringWrapper keys without pooling a string (see HashMap find)
+class StaticString
+{
+public:
+  constexpr StaticString()
+      : chars_("")
+      , length_(0)
+  {
+  }
+  template < usize Size >
+  constexpr StaticString(const char (&literal)[Size])
+      : chars_(literal)
+      , length_(Size - 1)
+  {
+  }
+  constexpr StaticString(const char* chars, const usize length)
+      : chars_(chars)
+      , length_(length)
+  {
+  }
+
+  constexpr bool operator==(const StaticString& otherStr) const
+  {
+    if(this->length_ != otherStr.length_)
+    {
+      return false;
+    }
+    for(usize i = 0; i < this->length_; i++)
+    {
+      if(this->chars_[i] != otherStr.chars_[i])
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  constexpr const char* cStr() const { return this->chars_; }
+  constexpr usize length() const { return this->length_; }
+
+private:
+  const char* chars_;
+  usize length_;
+};
+
+// hash the characters, at compile time as well
+template <>
+struct Hasher< StaticString >
+{
+  static constexpr Hashes hash(const StaticString& key, const u64 seed)
+  {
+    return hashChars(key.cStr(), key.length(), seed);
+  }
+};
+
+// hash the pooled characters (the wrapper itself only holds pointers)
+// NOTE: a StaticString probe hashes the same characters the same way, so
+// maps of StringWrapper keys are looked up without pooling a string
+template <>
+struct Hasher< StringWrapper >
+{
+  static Hashes hash(const StringWrapper& key, const u64 seed)
+  {
+    return hashBytes(key.cStr(), key.length(), seed);
+  }
+  static Hashes hash(const StaticString& probe, const u64 seed)
+  {
+    return hashBytes(probe.cStr(), probe.length(), seed);
+  }
+};
+
+// compare pooled and viewed characters
+inline bool operator==(const StringWrapper& str, const StaticString& view)
+{
+  return str.length() == view.length() &&
+         std::equal(str.cStr(), (str.cStr() + str.length()), view.cStr());
+}
+
+inline bool operator==(const StaticString& view, const StringWrapper& str) { return str == view; }
 
 // TODO: add string manipulation functions.
 
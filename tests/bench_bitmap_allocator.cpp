@@ -0,0 +1,112 @@
+/**
+The MIT License (MIT)
+
+Copyright (c) 2016 Flavio Moreira
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// per operation cost of BitMapAllocator on a pool of 64 B blocks filled to
+// 90% in random order (the free blocks are scattered over the whole pool):
+// churn frees a random used block and allocates one, first-free allocates
+// the first free block and frees it again.
+// build and run from the repository root:
+//   g++ -std=c++14 -O2 -I include -o bench_bitmap_allocator tests/bench_bitmap_allocator.cpp
+//   ./bench_bitmap_allocator
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "memory.hpp"
+
+using namespace Montreal;
+
+using Clock = std::chrono::steady_clock;
+
+// nanoseconds per operation since start
+double nsPerOp(const Clock::time_point start, const usize ops)
+{
+  return std::chrono::duration< double, std::nano >(Clock::now() - start).count() / ops;
+}
+
+template < usize size >
+void bench(const char* pool, usize& failures)
+{
+  const usize block = 64;
+  const usize blocks = size / block;
+  const usize ops = 1 << 20;
+  using Allocator = BitMapAllocator< size, block >;
+  // the maps of a large pool do not fit on the stack
+  Allocator* alloc = new Allocator();
+  std::mt19937_64 random(5);
+
+  std::vector< Blk > used(blocks);
+  for(Blk& b : used)
+  {
+    b = alloc->allocate(block);
+  }
+  for(usize i = blocks - 1; i > 0; i--)
+  {
+    std::swap(used[i], used[random() % (i + 1)]);
+  }
+  for(usize i = 0; i < blocks / 10; i++)
+  {
+    alloc->deallocate(used.back());
+    used.pop_back();
+  }
+
+  Clock::time_point start = Clock::now();
+  for(usize i = 0; i < ops; i++)
+  {
+    Blk& b = used[random() % used.size()];
+    alloc->deallocate(b);
+    b = alloc->allocate(block);
+    failures += b.ptr ? 0 : 1;
+  }
+  const double churn = nsPerOp(start, ops);
+
+  start = Clock::now();
+  for(usize i = 0; i < ops; i++)
+  {
+    const Blk b = alloc->allocate(block);
+    failures += b.ptr ? 0 : 1;
+    alloc->deallocate(b);
+  }
+  const double firstFree = nsPerOp(start, ops);
+
+  std::printf("%-7s %8.1f %11.1f\n", pool, churn, firstFree);
+  for(const Blk& b : used)
+  {
+    alloc->deallocate(b);
+  }
+  delete alloc;
+}
+
+int main()
+{
+  usize failures = 0;
+  std::printf("ns/op      churn  first-free\n");
+  bench< (1 << 20) >("1 MB", failures);
+  bench< (1 << 28) >("256 MB", failures);
+  std::printf("failed allocations %zu\n", failures);
+  return failures ? 1 : 0;
+}
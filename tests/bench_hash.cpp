@@ -0,0 +1,86 @@
+/**
+The MIT License (MIT)
+
+Copyright (c) 2016 Flavio Moreira
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// per key cost of the single pass hash (hashBytes) against the previous
+// three algorithm hash (one CityHash64, MurmurHash64A and SpookyHash pass
+// per lane), over keys of several sizes.
+// build and run from the repository root:
+//   g++ -std=c++14 -O2 -I include -o bench_hash tests/bench_hash.cpp
+//       include/hashes/City.cpp include/hashes/MurmurHash2.cpp include/hashes/Spooky.cpp
+//   ./bench_hash
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "hash.hpp"
+
+using namespace Montreal;
+
+// lanes as the triple hash mode fills them
+inline Hashes tripleHash(const char* bytes, const usize len, const u64 seed)
+{
+  Hashes r;
+  r.murmur = MurmurHash64A(bytes, static_cast< int >(len), seed);
+  r.city = CityHash64WithSeed(bytes, len, seed);
+  r.spooky = SpookyHash::Hash64(bytes, len, seed);
+  return r;
+}
+
+// nanoseconds per key of a hash function
+template < typename HashFunction >
+double nsPerKey(const std::vector< char >& data, const usize len, HashFunction function, u64& sink)
+{
+  const usize keys = 2000000;
+  const auto start = std::chrono::steady_clock::now();
+  for(usize i = 0; i < keys; i++)
+  {
+    const Hashes h = function(&data[(i * 61) % (data.size() - len)], len, i);
+    sink += h.h[0] ^ h.h[1] ^ h.h[2];
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration< double, std::nano >(end - start).count() / keys;
+}
+
+int main()
+{
+  std::vector< char > data(1 << 20);
+  for(usize i = 0; i < data.size(); i++)
+  {
+    data[i] = static_cast< char >(i * 131 + 7);
+  }
+
+  u64 sink = 0;
+  std::printf("key size   triple ns   single ns\n");
+  for(const usize len : {8, 16, 32, 64, 256, 1024})
+  {
+    const double triple = nsPerKey(data, len, tripleHash, sink);
+    const double single = nsPerKey(
+        data, len, [](const char* b, usize l, u64 s) { return hashBytes(b, l, s); }, sink);
+    std::printf("%6zu B   %9.1f   %9.1f\n", len, triple, single);
+  }
+  // keeps the hashes from being optimized away
+  std::printf("checksum %llu\n", static_cast< unsigned long long >(sink));
+  return 0;
+}
@@ -0,0 +1,139 @@
+/**
+The MIT License (MIT)
+
+Copyright (c) 2016 Flavio Moreira
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// per operation cost of the swiss engine against the cuckoo engine:
+// HashMap< u64, u64 > with 1M random keys, the table sized for 1.25M
+// elements (so neither engine grows while inserting). churn removes a key
+// and inserts a new one, mix is 90% finds and 10% churn.
+// build and run from the repository root:
+//   g++ -std=c++14 -O2 -I include -o bench_hashmap_engines tests/bench_hashmap_engines.cpp
+//       include/hashes/City.cpp
+//   ./bench_hashmap_engines
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "hashmap.hpp"
+
+using namespace Montreal;
+
+// malloc backed allocator
+struct BenchAllocator
+{
+  Blk allocate(const usize size) { return {std::malloc(size), size}; }
+  void deallocate(Blk b) { std::free(b.ptr); }
+};
+
+using Clock = std::chrono::steady_clock;
+
+// nanoseconds per operation since start
+double nsPerOp(const Clock::time_point start, const usize ops)
+{
+  return std::chrono::duration< double, std::nano >(Clock::now() - start).count() / ops;
+}
+
+template < typename Engine >
+void bench(const char* engine, u64& sink)
+{
+  const usize keyCount = 1 << 20;
+  BenchAllocator alloc;
+  std::mt19937_64 random(3);
+  std::vector< u64 > keys(keyCount);
+  for(u64& key : keys)
+  {
+    key = random();
+  }
+  HashMap< u64, u64, BenchAllocator, Engine > map(alloc, {0, 0}, keyCount * 10 / 8);
+
+  Clock::time_point start = Clock::now();
+  for(usize i = 0; i < keyCount; i++)
+  {
+    emplace(map, keys[i], u64(i));
+  }
+  const double insert = nsPerOp(start, keyCount);
+
+  start = Clock::now();
+  for(usize i = 0; i < keyCount; i++)
+  {
+    const u64* entry = find(map, keys[(i * 7919) & (keyCount - 1)]);
+    sink += entry ? *entry : 0;
+  }
+  const double findHit = nsPerOp(start, keyCount);
+
+  start = Clock::now();
+  for(usize i = 0; i < keyCount; i++)
+  {
+    const u64* entry = find(map, keys[i] ^ 1);
+    sink += entry ? *entry : 0;
+  }
+  const double findMiss = nsPerOp(start, keyCount);
+
+  start = Clock::now();
+  for(usize i = 0; i < keyCount; i++)
+  {
+    remove(map, keys[i]);
+    keys[i] = random();
+    emplace(map, keys[i], u64(i));
+  }
+  const double churn = nsPerOp(start, 2 * keyCount);
+
+  start = Clock::now();
+  for(usize i = 0; i < keyCount; i++)
+  {
+    const usize j = random() & (keyCount - 1);
+    if((i % 10) == 0)
+    {
+      remove(map, keys[j]);
+      keys[j] = random();
+      emplace(map, keys[j], u64(i));
+    }
+    else
+    {
+      const u64* entry = find(map, keys[j]);
+      sink += entry ? *entry : 0;
+    }
+  }
+  const double mix = nsPerOp(start, keyCount);
+
+  std::printf(
+      "%-7s %8.1f %10.1f %11.1f %7.1f %7.1f\n", engine, insert, findHit, findMiss, churn, mix);
+}
+
+int main()
+{
+  u64 sink = 0;
+  std::printf("ns/op     insert   find-hit   find-miss   churn     mix\n");
+  // second round: warm caches and allocator
+  for(int round = 0; round < 2; round++)
+  {
+    bench< CuckooEngine >("cuckoo", sink);
+    bench< SwissEngine >("swiss", sink);
+  }
+  // keeps the lookups from being optimized away
+  std::printf("checksum %llu\n", static_cast< unsigned long long >(sink));
+  return 0;
+}
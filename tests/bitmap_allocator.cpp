@@ -0,0 +1,261 @@
+/**
+The MIT License (MIT)
+
+Copyright (c) 2016 Flavio Moreira
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// BitMapAllocator: single blocks and runs of blocks that cross the 64 bit
+// words of the map are allocated and freed at random, and every allocation
+// is checked against a first fit over a plain vector of block states. live
+// blocks keep their fill pattern, and once everything is freed the whole
+// pool is one run again. pools of more than 4096 blocks have several
+// summary words (one bit per map word), runs across them and blocks in the
+// partial last words are checked on their own.
+// build and run from the repository root:
+//   g++ -std=c++14 -O2 -I include -o bitmap_allocator tests/bitmap_allocator.cpp
+//   ./bitmap_allocator
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "memory.hpp"
+
+using namespace Montreal;
+
+GLOBAL const usize blockSize = 16;
+
+GLOBAL usize failures = 0;
+
+void check(const bool ok, const char* pool, const char* what)
+{
+  if(!ok)
+  {
+    std::printf("%s: %s failed\n", pool, what);
+    ++failures;
+  }
+}
+
+// linear congruential generator, so a run is repeatable
+inline u32 nextRandom(u32& state)
+{
+  state = state * 1103515245u + 12345u;
+  return state >> 8;
+}
+
+// first run of free blocks in a plain vector of block states
+// @return index of the first block of the run or used.size() if there is none
+usize firstFit(const std::vector< bool >& used, const usize count)
+{
+  usize run = 0;
+  for(usize b = 0; b < used.size(); b++)
+  {
+    run = used[b] ? 0 : run + 1;
+    if(run == count)
+    {
+      return b + 1 - count;
+    }
+  }
+  return used.size();
+}
+
+// allocate count blocks and check the run is where a first fit puts it
+// @return the block or {nullptr, 0} when there is no room
+template < typename Pool >
+Blk allocateRun(Pool& pool, std::vector< bool >& used, char* base, const usize count, usize& bad)
+{
+  const usize expected = firstFit(used, count);
+  const Blk b = pool.allocate(count * blockSize);
+  const usize first =
+      b.ptr ? static_cast< usize >(static_cast< char* >(b.ptr) - base) / blockSize : used.size();
+  bad += (first != expected) ? 1 : 0;
+  for(usize i = first; b.ptr && i < first + count; i++)
+  {
+    used[i] = true;
+  }
+  return b;
+}
+
+// free a run of blocks allocated by allocateRun
+template < typename Pool >
+void freeRun(Pool& pool, std::vector< bool >& used, char* base, const Blk b)
+{
+  const usize first = static_cast< usize >(static_cast< char* >(b.ptr) - base) / blockSize;
+  for(usize i = first; i < first + b.size / blockSize; i++)
+  {
+    used[i] = false;
+  }
+  pool.deallocate(b);
+}
+
+template < usize blocks >
+void testRuns(const char* name, const usize maxRun, const usize ops)
+{
+  using Pool = BitMapAllocator< blocks * blockSize, blockSize >;
+  Pool* pool = new Pool();
+  std::vector< bool > used(blocks, false);
+
+  // the first block of an empty pool is the pool start
+  const Blk probe = pool->allocate(1);
+  char* base = static_cast< char* >(probe.ptr);
+  pool->deallocate(probe);
+  check(base != nullptr, name, "allocate a block");
+
+  // run lengths around the word size, plus random ones
+  const usize edges[] = {1, 1, 2, 63, 64, 65, 127, 128, 129};
+  const usize slots = 256;
+  Blk live[slots] = {};
+  u8 marks[slots] = {};
+  u32 state = 11;
+  usize mismatches = 0;
+  usize overwritten = 0;
+  for(usize i = 0; i < ops; i++)
+  {
+    const usize k = nextRandom(state) % slots;
+    if(live[k].ptr)
+    {
+      const usize first =
+          static_cast< usize >(static_cast< char* >(live[k].ptr) - base) / blockSize;
+      const usize count = (live[k].size + blockSize - 1) / blockSize;
+      const u8* bytes = static_cast< const u8* >(live[k].ptr);
+      for(usize j = 0; j < live[k].size; j++)
+      {
+        overwritten += (bytes[j] != marks[k]) ? 1 : 0;
+      }
+      pool->deallocate(live[k]);
+      for(usize b = first; b < first + count; b++)
+      {
+        used[b] = false;
+      }
+      live[k] = {nullptr, 0};
+      continue;
+    }
+    const u32 pick = nextRandom(state) % 16;
+    const usize count = (pick < 9) ? edges[pick] : 1 + nextRandom(state) % maxRun;
+    // any size that rounds up to count blocks
+    const usize n = count * blockSize - nextRandom(state) % blockSize;
+    const usize expected = firstFit(used, count);
+    live[k] = pool->allocate(n);
+    const usize first =
+        live[k].ptr ? static_cast< usize >(static_cast< char* >(live[k].ptr) - base) / blockSize
+                    : blocks;
+    mismatches += (first != expected) ? 1 : 0;
+    if(live[k].ptr)
+    {
+      for(usize b = first; b < first + count; b++)
+      {
+        used[b] = true;
+      }
+      marks[k] = static_cast< u8 >(i);
+      std::memset(live[k].ptr, marks[k], n);
+    }
+  }
+  check(mismatches == 0, name, "allocations match a first fit");
+  check(overwritten == 0, name, "live blocks keep their contents");
+
+  for(Blk& b : live)
+  {
+    if(b.ptr)
+    {
+      pool->deallocate(b);
+    }
+  }
+  const Blk whole = pool->allocate(blocks * blockSize);
+  check(whole.ptr == base, name, "whole pool after random use");
+  check(!pool->allocate(1).ptr, name, "full pool refuses");
+  pool->deallocate(whole);
+  delete pool;
+}
+
+// runs around the summary word boundaries (every 4096 blocks) of a pool
+// that ends in a partial map word of a partial summary word
+void testSummaryEdges()
+{
+  const usize blocks = 3 * 4096 + 70;
+  const char* name = "summary edges";
+  using Pool = BitMapAllocator< blocks * blockSize, blockSize >;
+  Pool* pool = new Pool();
+  std::vector< bool > used(blocks, false);
+  std::vector< Blk > live;
+  usize bad = 0;
+
+  const Blk probe = pool->allocate(1);
+  char* base = static_cast< char* >(probe.ptr);
+  pool->deallocate(probe);
+
+  // singles up to just before the first summary boundary, then a run across it
+  for(usize i = 0; i < 4096 - 10; i++)
+  {
+    live.push_back(allocateRun(*pool, used, base, 1, bad));
+  }
+  const Blk across = allocateRun(*pool, used, base, 20, bad);
+  check(bad == 0 && across.ptr == base + (4096 - 10) * blockSize,
+        name,
+        "run across a summary word");
+  // a run over a whole summary word and into the next
+  const Blk wide = allocateRun(*pool, used, base, 4096 + 100, bad);
+  check(bad == 0 && wide.ptr, name, "run over a whole summary word");
+  // fill the rest one block at a time: the last block is in a partial word
+  usize filled = 0;
+  for(Blk b; (b = allocateRun(*pool, used, base, 1, bad)).ptr; filled++)
+  {
+    live.push_back(b);
+  }
+  check(bad == 0 && filled == blocks - (4096 - 10) - 20 - (4096 + 100), name, "fill the pool");
+  check(static_cast< char* >(live.back().ptr) == base + (blocks - 1) * blockSize,
+        name,
+        "last block of the pool");
+
+  // holes in full summary words are found again
+  freeRun(*pool, used, base, live[4000]);
+  freeRun(*pool, used, base, live.back());
+  live[4000] = allocateRun(*pool, used, base, 1, bad);
+  live.back() = allocateRun(*pool, used, base, 1, bad);
+  check(bad == 0 && live.back().ptr, name, "reuse holes in full summary words");
+
+  // a freed run that crosses a summary boundary is reused as a run
+  freeRun(*pool, used, base, across);
+  const Blk again = allocateRun(*pool, used, base, 20, bad);
+  check(bad == 0 && again.ptr == across.ptr, name, "reuse a run across a summary word");
+  check(!allocateRun(*pool, used, base, 1, bad).ptr && bad == 0, name, "full pool refuses");
+
+  freeRun(*pool, used, base, again);
+  freeRun(*pool, used, base, wide);
+  for(const Blk& b : live)
+  {
+    freeRun(*pool, used, base, b);
+  }
+  const Blk whole = pool->allocate(blocks * blockSize);
+  check(whole.ptr == base, name, "whole pool");
+  pool->deallocate(whole);
+  delete pool;
+}
+
+int main()
+{
+  // a pool that does not end on a word boundary
+  testRuns< 1000 >("1000 blocks", 300, 100000);
+  // several summary words, the last one partial
+  testRuns< 2 * 4096 + 200 >("8392 blocks", 2000, 20000);
+  testSummaryEdges();
+  std::printf("%s\n", failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+/**
+The MIT License (MIT)
+
+Copyright (c) 2016 Flavio Moreira
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// BuddyAllocator: every leaf of the arena is handed out once, the leaves are
+// freed in mixed order and the buddies merge back into the whole arena, then
+// random sizes are allocated and freed while every live block keeps its
+// fill pattern (no two blocks overlap).
+// build and run from the repository root (-fsanitize=address,undefined also
+// checks the bitmaps and the free lists):
+//   g++ -std=c++14 -O2 -I include -o buddy_allocator tests/buddy_allocator.cpp
+//   ./buddy_allocator
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "memory.hpp"
+
+using namespace Montreal;
+
+GLOBAL const usize arenaSize = 1 << 16;
+GLOBAL const usize leafSize = 64;
+using Buddy = BuddyAllocator< arenaSize, leafSize >;
+
+GLOBAL usize failures = 0;
+
+void check(const bool ok, const char* what)
+{
+  if(!ok)
+  {
+    std::printf("%s failed\n", what);
+    ++failures;
+  }
+}
+
+// linear congruential generator, so a run is repeatable
+inline u32 nextRandom(u32& state)
+{
+  state = state * 1103515245u + 12345u;
+  return state >> 8;
+}
+
+void testLeaves(Buddy& buddy)
+{
+  const usize leaves = arenaSize / leafSize;
+  std::vector< Blk > blocks;
+  std::vector< bool > seen(leaves, false);
+  usize bad = 0;
+  for(usize i = 0; i < leaves; i++)
+  {
+    const Blk b = buddy.allocate(1 + i % leafSize);
+    bad += (!b.ptr || !buddy.owns(b) || reinterpret_cast< usize >(b.ptr) % leafSize) ? 1 : 0;
+    blocks.push_back(b);
+  }
+  check(bad == 0, "allocate every leaf");
+  check(!buddy.allocate(1).ptr, "full arena refuses");
+
+  // every leaf once: the lowest address is the arena start
+  bad = 0;
+  char* base = static_cast< char* >(blocks[0].ptr);
+  for(const Blk& b : blocks)
+  {
+    base = std::min(base, static_cast< char* >(b.ptr));
+  }
+  for(const Blk& b : blocks)
+  {
+    const usize leaf = (static_cast< char* >(b.ptr) - base) / leafSize;
+    bad += (leaf >= leaves || seen[leaf]) ? 1 : 0;
+    if(leaf < leaves)
+    {
+      seen[leaf] = true;
+    }
+  }
+  check(bad == 0, "leaves are distinct");
+
+  // mixed order: a stride coprime with the leaf count visits every leaf
+  for(usize i = 0; i < leaves; i++)
+  {
+    buddy.deallocate(blocks[(i * 389) % leaves]);
+  }
+  const Blk whole = buddy.allocate(arenaSize);
+  check(whole.ptr == base, "buddies merge back into the whole arena");
+  buddy.deallocate(whole);
+}
+
+void testRandom(Buddy& buddy)
+{
+  const usize slots = 64;
+  Blk live[slots] = {};
+  u8 marks[slots] = {};
+  u32 state = 7;
+  usize bad = 0;
+  for(usize i = 0; i < 200000; i++)
+  {
+    const usize k = nextRandom(state) % slots;
+    if(live[k].ptr)
+    {
+      const u8* bytes = static_cast< const u8* >(live[k].ptr);
+      for(usize j = 0; j < live[k].size; j++)
+      {
+        bad += (bytes[j] != marks[k]) ? 1 : 0;
+      }
+      buddy.deallocate(live[k]);
+    }
+    live[k] = buddy.allocate(1 + nextRandom(state) % (arenaSize / 16));
+    marks[k] = static_cast< u8 >(i);
+    if(live[k].ptr)
+    {
+      std::memset(live[k].ptr, marks[k], live[k].size);
+    }
+  }
+  check(bad == 0, "live blocks keep their contents");
+  for(Blk& b : live)
+  {
+    if(b.ptr)
+    {
+      buddy.deallocate(b);
+    }
+  }
+  const Blk whole = buddy.allocate(arenaSize);
+  check(whole.ptr != nullptr, "whole arena after random use");
+  buddy.deallocate(whole);
+}
+
+int main()
+{
+  static Buddy buddy;
+  testLeaves(buddy);
+  testRandom(buddy);
+  std::printf("%s\n", failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+/**
+The MIT License (MIT)
+
+Copyright (c) 2016 Flavio Moreira
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// ConcurrentHashMap shared by several threads: writers insert (and remove
+// part of) disjoint key ranges while readers look keys up, then every key
+// is checked from one thread. a table filled past its capacity must refuse
+// insertions without losing the elements it holds.
+// build and run from the repository root (-fsanitize=thread also checks the
+// locking):
+//   g++ -std=c++14 -O2 -pthread -I include -o concurrent_hashmap tests/concurrent_hashmap.cpp
+//       include/hashes/City.cpp
+//   ./concurrent_hashmap
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "concurrent_hashmap.hpp"
+
+using namespace Montreal;
+
+struct MallocAllocator
+{
+  Blk allocate(const usize size) { return {std::malloc(size), size}; }
+  void deallocate(Blk b) { std::free(b.ptr); }
+};
+
+using Map = ConcurrentHashMap< u64, u64, MallocAllocator >;
+
+GLOBAL usize failures = 0;
+
+void check(const bool ok, const char* what)
+{
+  if(!ok)
+  {
+    std::printf("%s failed\n", what);
+    ++failures;
+  }
+}
+
+// every 8th key is removed again by its writer
+inline bool kept(const u64 key)
+{
+  return (key & 7) != 0;
+}
+
+void testSharedInsertFind()
+{
+  const u64 keys = 1 << 18;
+  const u64 writers = 4;
+  const u64 readers = 2;
+  MallocAllocator alloc;
+  Map map(alloc, {0, 0}, keys + keys / 8);
+
+  std::atomic< u64 > emplaceFailures{0};
+  std::atomic< u64 > wrongValues{0};
+  std::atomic< u64 > done{0};
+  std::vector< std::thread > threads;
+  for(u64 t = 0; t < writers; t++)
+  {
+    threads.emplace_back([&, t] {
+      for(u64 k = t; k < keys; k += writers)
+      {
+        if(!emplace(map, k, k * 7))
+        {
+          ++emplaceFailures;
+        }
+        if(!kept(k))
+        {
+          remove(map, k);
+        }
+      }
+      ++done;
+    });
+  }
+  for(u64 t = 0; t < readers; t++)
+  {
+    threads.emplace_back([&, t] {
+      // a key is either missing (not inserted yet, or removed) or has its value
+      while(done.load() < writers)
+      {
+        for(u64 k = t; k < keys; k += 97)
+        {
+          u64 value = 0;
+          if(find(map, k, value) && value != k * 7)
+          {
+            ++wrongValues;
+          }
+        }
+      }
+    });
+  }
+  for(std::thread& thread : threads)
+  {
+    thread.join();
+  }
+  check(emplaceFailures.load() == 0, "concurrent emplace");
+  check(wrongValues.load() == 0, "concurrent find");
+
+  usize bad = 0;
+  for(u64 k = 0; k < keys; k++)
+  {
+    u64 value = 0;
+    const bool found = find(map, k, value);
+    bad += (found != kept(k) || (found && value != k * 7)) ? 1 : 0;
+  }
+  check(bad == 0, "find after join");
+  check(len(map) == keys - keys / 8, "length after join");
+
+  clear(map);
+  check(len(map) == 0 && count(map, u64(1)) == 0, "clear");
+}
+
+void testFull()
+{
+  MallocAllocator alloc;
+  Map map(alloc, {0, 0}, 1024);
+  u64 inserted = 0;
+  while(emplace(map, inserted, inserted))
+  {
+    ++inserted;
+  }
+  check(inserted > 0 && inserted <= capacity(map), "fill to capacity");
+  check(len(map) == inserted, "length of a full table");
+  check(count(map, inserted) == 0, "refused key left out");
+
+  usize found = 0;
+  for(u64 k = 0; k < inserted; k++)
+  {
+    u64 value = ~u64(0);
+    found += (find(map, k, value) && value == k) ? 1 : 0;
+  }
+  check(found == inserted, "elements kept by a full table");
+  check(emplace(map, u64(0), u64(42)), "overwrite in a full table");
+}
+
+int main()
+{
+  testSharedInsertFind();
+  testFull();
+  std::printf("%s\n", failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+/**
+The MIT License (MIT)
+
+Copyright (c) 2016 Flavio Moreira
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// HashMapImage: maps saved with saveImage and mapped with openImage are
+// looked up in place (integer keys, and StringWrapper keys by StaticString
+// probe), and images that are truncated, corrupt or built for other types
+// are refused by openImage.
+// build and run from the repository root (the images are written to the
+// current directory and removed at the end):
+//   g++ -std=c++14 -O2 -I include -o hashmap_image tests/hashmap_image.cpp
+//       include/hashes/City.cpp
+//   ./hashmap_image
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "hashmap_image.hpp"
+
+using namespace Montreal;
+
+struct MallocAllocator
+{
+  Blk allocate(const usize size) { return {std::malloc(size), size}; }
+  void deallocate(Blk b) { std::free(b.ptr); }
+};
+
+GLOBAL const char* intImagePath = "hashmap_image_int.bin";
+GLOBAL const char* stringImagePath = "hashmap_image_string.bin";
+GLOBAL const char* badImagePath = "hashmap_image_bad.bin";
+
+GLOBAL usize failures = 0;
+
+void check(const bool ok, const char* what)
+{
+  if(!ok)
+  {
+    std::printf("%s failed\n", what);
+    ++failures;
+  }
+}
+
+// read a whole file
+std::vector< char > readFile(const char* path)
+{
+  std::vector< char > bytes;
+  std::FILE* file = std::fopen(path, "rb");
+  if(file)
+  {
+    char buf[4096];
+    for(usize n; (n = std::fread(buf, 1, sizeof(buf), file)) > 0;)
+    {
+      bytes.insert(bytes.end(), buf, buf + n);
+    }
+    std::fclose(file);
+  }
+  return bytes;
+}
+
+// write the first size bytes of an image to badImagePath
+void writeFile(const std::vector< char >& bytes, const usize size)
+{
+  std::FILE* file = std::fopen(badImagePath, "wb");
+  if(file)
+  {
+    std::fwrite(bytes.data(), 1, size, file);
+    std::fclose(file);
+  }
+}
+
+// copy of an image with a u64 header field replaced
+// @param offset field offset in HashMapImageHeader
+std::vector< char > patched(const std::vector< char >& bytes, const usize offset, const u64 value)
+{
+  std::vector< char > copy(bytes);
+  std::memcpy(copy.data() + offset, &value, sizeof(value));
+  return copy;
+}
+
+void testIntKeys()
+{
+  const u64 keys = 5000;
+  MallocAllocator alloc;
+  HashMap< u64, u64, MallocAllocator > map(alloc, {0, 0}, 16);
+  for(u64 k = 1; k <= keys; k++)
+  {
+    emplace(map, k, k * 3);
+  }
+  for(u64 k = 1; k <= keys; k += 5)
+  {
+    remove(map, k);
+  }
+  check(saveImage(map, intImagePath), "save integer keys");
+
+  HashMapImage< u64, u64 > image;
+  check(openImage(image, intImagePath), "open integer keys");
+  check(len(image) == len(map), "image length");
+  usize bad = 0;
+  for(u64 k = 1; k <= keys; k++)
+  {
+    const u64* value = find(image, k);
+    const u64* expected = find(map, k);
+    bad += (expected ? !value || *value != *expected : value != nullptr) ? 1 : 0;
+  }
+  check(bad == 0, "image find");
+  check(count(image, keys + 1) == 0, "image find missing key");
+
+  // the image is only usable with the types it was saved with
+  HashMapImage< u64, u32 > otherEntry;
+  check(!openImage(otherEntry, intImagePath), "refuse other entry type");
+  check(!openImage(image, "hashmap_image_missing.bin"), "refuse missing file");
+  check(len(image) == 0, "closed after a failed open");
+}
+
+void testStringKeys()
+{
+  const u32 keys = 3000;
+  FixedStringPool< 1 << 20 >* pool = new FixedStringPool< 1 << 20 >();
+  MallocAllocator alloc;
+  char buf[32];
+  {
+    StringWrapper empty(pool);
+    HashMap< StringWrapper, u32, MallocAllocator > map(alloc, {empty, 0}, 8);
+    for(u32 i = 0; i < keys; i++)
+    {
+      std::snprintf(buf, sizeof(buf), "name-%u", i);
+      emplace(map, StringWrapper(pool, buf), i);
+    }
+    check(saveImage(map, stringImagePath), "save string keys");
+  }
+  delete pool;
+
+  // the pool is gone: the image does not point into it
+  HashMapImage< StringWrapper, u32 > image;
+  check(openImage(image, stringImagePath), "open string keys");
+  check(len(image) == keys, "string image length");
+  usize found = 0;
+  for(u32 i = 0; i < keys; i++)
+  {
+    std::snprintf(buf, sizeof(buf), "name-%u", i);
+    const u32* value = find(image, StaticString(buf, std::strlen(buf)));
+    found += (value && *value == i) ? 1 : 0;
+  }
+  check(found == keys, "string image find");
+  check(count(image, StaticString("name-")) == 0, "string image find missing key");
+}
+
+void testBadImages()
+{
+  const std::vector< char > bytes = readFile(intImagePath);
+  check(bytes.size() > sizeof(HashMapImageHeader), "read image");
+  HashMapImage< u64, u64 > image;
+
+  writeFile(bytes, bytes.size());
+  check(openImage(image, badImagePath), "open copied image");
+
+  writeFile(bytes, sizeof(HashMapImageHeader) - 1);
+  check(!openImage(image, badImagePath), "refuse image shorter than its header");
+  writeFile(bytes, bytes.size() - 1);
+  check(!openImage(image, badImagePath), "refuse truncated image");
+  writeFile(bytes, 0);
+  check(!openImage(image, badImagePath), "refuse empty file");
+
+  std::vector< char > badMagic(bytes);
+  badMagic[0] = 'X';
+  writeFile(badMagic, badMagic.size());
+  check(!openImage(image, badImagePath), "refuse bad magic");
+
+  std::vector< char > badFlags(bytes);
+  badFlags[offsetof(HashMapImageHeader, flags_)] ^= 0x2;
+  writeFile(badFlags, badFlags.size());
+  check(!openImage(image, badImagePath), "refuse other hash variant");
+
+  // offsets and counts that would wrap around when added or multiplied
+  const struct
+  {
+    usize offset;
+    u64 value;
+    const char* what;
+  } fields[] = {
+      {offsetof(HashMapImageHeader, buckets_), u64(1) << 61, "refuse huge bucket count"},
+      {offsetof(HashMapImageHeader, buckets_), 0, "refuse zero buckets"},
+      {offsetof(HashMapImageHeader, length_), ~u64(0), "refuse bad length"},
+      {offsetof(HashMapImageHeader, tagsOffset_), 0, "refuse tags over the header"},
+      {offsetof(HashMapImageHeader, tableOffset_), ~u64(0) - 63, "refuse wrapping table offset"},
+      {offsetof(HashMapImageHeader, stashOffset_), ~u64(0) - 63, "refuse wrapping stash offset"},
+      {offsetof(HashMapImageHeader, blobOffset_), ~u64(0), "refuse wrapping blob offset"},
+      {offsetof(HashMapImageHeader, size_), ~u64(0), "refuse bad size"},
+  };
+  for(const auto& field : fields)
+  {
+    const std::vector< char > bad = patched(bytes, field.offset, field.value);
+    writeFile(bad, bad.size());
+    check(!openImage(image, badImagePath), field.what);
+  }
+  check(len(image) == 0, "nothing open after refused images");
+}
+
+int main()
+{
+  testIntKeys();
+  testStringKeys();
+  testBadImages();
+  std::remove(intImagePath);
+  std::remove(stringImagePath);
+  std::remove(badImagePath);
+  std::printf("%s\n", failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
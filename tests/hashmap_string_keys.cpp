@@ -0,0 +1,154 @@
+/**
+The MIT License (MIT)
+
+Copyright (c) 2016 Flavio Moreira
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// StringWrapper keyed maps (cuckoo and swiss engines): lookups and removals by
+// key and by StaticString probe across growth, incremental migration, removal,
+// copy and assignment, over an allocator that hands out garbage filled memory.
+// every pooled string must be released once the maps are gone.
+// build and run from the repository root (-fsanitize=address also catches
+// slots that are used without being built):
+//   g++ -std=c++14 -O2 -I include -o hashmap_string_keys tests/hashmap_string_keys.cpp
+//       include/hashes/City.cpp
+//   ./hashmap_string_keys
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "hashmap.hpp"
+#include "strings.hpp"
+
+using namespace Montreal;
+
+// malloc backed allocator that does not hand out zeroed memory
+struct GarbageAllocator
+{
+  Blk allocate(const usize size)
+  {
+    void* ptr = std::malloc(size);
+    std::memset(ptr, 0xab, size);
+    return {ptr, size};
+  }
+  void deallocate(Blk b) { std::free(b.ptr); }
+};
+
+// string pool that counts its live strings
+class CountingPool : public StringPoolInterface
+{
+public:
+  usize live_{0};
+
+private:
+  virtual allocResult allocate(const u16& length) override
+  {
+    ++this->live_;
+    char* str = static_cast< char* >(std::calloc(length + 1, 1));
+    u16* refCount = static_cast< u16* >(std::calloc(1, sizeof(u16)));
+    return allocResult{NO_ERROR, str, refCount};
+  }
+  virtual ErrorCode deallocate(const u16&, char* str, u16* refCount) override
+  {
+    --this->live_;
+    std::free(str);
+    std::free(refCount);
+    return NO_ERROR;
+  }
+};
+
+GLOBAL usize failures = 0;
+
+void check(const bool ok, const char* engine, const char* what)
+{
+  if(!ok)
+  {
+    std::printf("%s: %s failed\n", engine, what);
+    ++failures;
+  }
+}
+
+template < typename Map >
+void testEngine(const char* engine)
+{
+  const u32 keys = 4000;
+  CountingPool pool;
+  GarbageAllocator alloc;
+  char buf[32];
+  {
+    StringWrapper empty(&pool);
+    // small initial capacity: the map grows (and migrates) several times
+    Map map(alloc, {empty, 0}, 8);
+    for(u32 i = 0; i < keys; i++)
+    {
+      std::snprintf(buf, sizeof(buf), "key-%u", i);
+      check(emplace(map, StringWrapper(&pool, buf), i), engine, "emplace");
+    }
+    check(len(map) == keys, engine, "length after emplace");
+    check(pool.live_ == keys, engine, "one pooled string per key");
+
+    usize found = 0;
+    for(u32 i = 0; i < keys; i++)
+    {
+      std::snprintf(buf, sizeof(buf), "key-%u", i);
+      const u32* byProbe = find(map, StaticString(buf, std::strlen(buf)));
+      const StringWrapper key(&pool, buf);
+      const u32* byKey = find(map, key);
+      found += (byProbe && *byProbe == i && byKey == byProbe) ? 1 : 0;
+    }
+    check(found == keys, engine, "find");
+    check(!find(map, StaticString("key-")), engine, "find missing key");
+
+    for(u32 i = 0; i < keys; i += 2)
+    {
+      std::snprintf(buf, sizeof(buf), "key-%u", i);
+      if(i % 4)
+      {
+        check(remove(map, StringWrapper(&pool, buf)), engine, "remove");
+      }
+      else
+      {
+        check(remove(map, StaticString(buf, std::strlen(buf))), engine, "remove by probe");
+      }
+    }
+    check(len(map) == keys / 2, engine, "length after remove");
+    check(pool.live_ == keys / 2, engine, "removed keys released");
+
+    Map copy(map);
+    Map assigned(alloc, {empty, 0}, 8);
+    emplace(assigned, StringWrapper(&pool, "replaced"), 1u);
+    assigned = map;
+    check(pool.live_ == keys / 2, engine, "copies share the pooled strings");
+    check(len(copy) == keys / 2 && len(assigned) == keys / 2, engine, "copy length");
+    check(count(copy, StaticString("key-1")) == 1, engine, "copy find");
+    check(count(assigned, StaticString("key-2")) == 0, engine, "assigned find removed");
+  }
+  check(pool.live_ == 0, engine, "every pooled string released");
+}
+
+int main()
+{
+  testEngine< HashMap< StringWrapper, u32, GarbageAllocator > >("cuckoo");
+  testEngine< HashMap< StringWrapper, u32, GarbageAllocator, SwissEngine > >("swiss");
+  std::printf("%s\n", failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}